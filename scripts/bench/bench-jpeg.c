@@ -0,0 +1,67 @@
+// Benchmark the boot splash JPEG decoder (src/jpeg.c).
+//
+// Usage: bench-jpeg <file.jpg>... [-n iterations]
+//
+// Each image is parsed and decoded into a linear buffer at 32, 24 and
+// 16 bits per pixel, the way enable_bootsplash() draws it.
+//
+// This file may be distributed under the terms of the GNU LGPLv3 license.
+
+#include "bench.h" // bench_printf
+#include "malloc.h" // malloc_tmphigh
+#include "util.h" // jpeg_decode
+
+static int
+bench_jpeg(const char *path, int iters)
+{
+    u32 size;
+    u8 *data = bench_loadfile(path, &size);
+    struct jpeg_decdata *jpeg = jpeg_alloc();
+    int ret = jpeg_decode(jpeg, data);
+    if (ret) {
+        // Older trees only decode 4:2:0 images
+        bench_printf("jpeg  %28s unsupported (jpeg_decode returned %d)\n"
+                     , bench_basename(path), ret);
+        return 0;
+    }
+    int width, height;
+    jpeg_get_size(jpeg, &width, &height);
+    u8 *pic = malloc_tmphigh(width * height * 4);
+    if (!pic) {
+        bench_printf("%s: out of memory\n", path);
+        return -1;
+    }
+
+    static const int depths[] = { 32, 24, 16 };
+    int i;
+    for (i = 0; i < ARRAY_SIZE(depths); i++) {
+        int depth = depths[i], bpl = width * ((depth + 7) / 8);
+        u32 heap = bench_heap_save();
+        u32 best = BENCH_BEST(({
+                    ret |= jpeg_decode(jpeg, data);
+                    ret |= jpeg_show(jpeg, pic, width, height, depth, bpl);
+                    bench_heap_restore(heap);
+                }), iters);
+        if (ret) {
+            bench_printf("%s: jpeg_show returned %d\n", path, ret);
+            return -1;
+        }
+        bench_printf("jpeg  %28s %4dx%4d %2dbpp %10t us  hash %x\n"
+                     , bench_basename(path), width, height, depth, best
+                     , bench_hash(pic, height * bpl));
+    }
+    return 0;
+}
+
+int
+bench_main(int argc, char **argv)
+{
+    int iters = bench_iterations(argc, argv, 15);
+    int i, ret = 0;
+    for (i = 1; i < argc; i++) {
+        if (!argv[i])
+            continue;
+        ret |= bench_jpeg(argv[i], iters);
+    }
+    return ret ? 1 : 0;
+}
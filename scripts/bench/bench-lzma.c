@@ -0,0 +1,64 @@
+// Benchmark the LZMA decoder (src/fw/lzmadecode.c).
+//
+// Usage: bench-lzma <file.lzma>... [-n iterations]
+//
+// Each file is an "lzma_alone" stream (5 property bytes, 8 byte size,
+// data) as produced by cbfstool or scripts/bench/mklzma.py.
+//
+// This file may be distributed under the terms of the GNU LGPLv3 license.
+
+#include "bench.h" // bench_printf
+#include "lzmadecode.h" // LzmaDecode
+#include "malloc.h" // malloc_tmphigh
+
+static int
+bench_lzma(const char *path, int iters)
+{
+    u32 srclen;
+    u8 *src = bench_loadfile(path, &srclen);
+    CLzmaDecoderState state;
+    if (srclen < LZMA_PROPERTIES_SIZE + 8
+        || LzmaDecodeProperties(&state.Properties, src, LZMA_PROPERTIES_SIZE)
+        != LZMA_RESULT_OK) {
+        bench_printf("%s: not an lzma stream\n", path);
+        return -1;
+    }
+    state.Probs = malloc_tmphigh(LzmaGetNumProbs(&state.Properties)
+                                 * sizeof(CProb));
+    u32 dstlen = *(u32*)(src + LZMA_PROPERTIES_SIZE);
+    u8 *dst = malloc_tmphigh(dstlen);
+    if (!state.Probs || !dst) {
+        bench_printf("%s: out of memory\n", path);
+        return -1;
+    }
+
+    int ret = 0;
+    u32 inProcessed, outProcessed;
+    u32 best = BENCH_BEST(
+        ret |= LzmaDecode(&state, src + LZMA_PROPERTIES_SIZE + 8
+                          , srclen - LZMA_PROPERTIES_SIZE - 8
+                          , &inProcessed, dst, dstlen, &outProcessed)
+        , iters);
+    if (ret || outProcessed != dstlen) {
+        bench_printf("%s: LzmaDecode returned %d\n", path, ret);
+        return -1;
+    }
+    bench_printf("lzma  %28s %7u -> %7u bytes %10t us %4u MB/s  hash %x\n"
+                 , bench_basename(path), srclen, dstlen, best
+                 , dstlen / (best / 1000 + 1)
+                 , bench_hash(dst, dstlen));
+    return 0;
+}
+
+int
+bench_main(int argc, char **argv)
+{
+    int iters = bench_iterations(argc, argv, 100);
+    int i, ret = 0;
+    for (i = 1; i < argc; i++) {
+        if (!argv[i])
+            continue;
+        ret |= bench_lzma(argv[i], iters);
+    }
+    return ret ? 1 : 0;
+}
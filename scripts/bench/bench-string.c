@@ -0,0 +1,63 @@
+// Benchmark the 32bit flat mode string routines (src/string.c).
+//
+// Usage: bench-string [-n iterations]
+//
+// The sizes mirror what POST does with them: checksumming option roms,
+// comparing rom images and romfile names, and clearing memory.
+//
+// This file may be distributed under the terms of the GNU LGPLv3 license.
+
+#include "bench.h" // bench_printf
+#include "string.h" // checksum
+
+// Time the out-of-line memcpy() rather than the inline builtin
+#undef memcpy
+
+#define BUFSIZE (128*1024)
+
+static u8 BufA[BUFSIZE + 4] __aligned(16), BufB[BUFSIZE + 4] __aligned(16);
+static char Names[64][32] __aligned(4);
+static volatile int Sink;
+
+static void
+report(const char *name, u32 best, u32 result)
+{
+    bench_printf("string %32s %10t us  result %x\n", name, best, result);
+}
+
+int
+bench_main(int argc, char **argv)
+{
+    int iters = bench_iterations(argc, argv, 500);
+    u32 seed = 1, i, j;
+    for (i = 0; i < sizeof(BufA); i++) {
+        seed = seed * 1103515245 + 12345;
+        BufA[i] = BufB[i] = seed >> 16;
+    }
+    for (i = 0; i < ARRAY_SIZE(Names); i++) {
+        strtcpy(Names[i], "genroms/file-0000.rom", sizeof(Names[i]));
+        Names[i][13] = '0' + i / 10;
+        Names[i][14] = '0' + i % 10;
+    }
+
+    report("checksum 128KiB", BENCH_BEST(Sink = checksum(BufA, BUFSIZE)
+                                         , iters), checksum(BufA, BUFSIZE));
+    report("memcmp 128KiB equal"
+           , BENCH_BEST(Sink = memcmp(BufA, BufB, BUFSIZE), iters)
+           , memcmp(BufA, BufB, BUFSIZE));
+    char *key = Names[ARRAY_SIZE(Names) - 1];
+    report("strcmp 64 romfile names"
+           , BENCH_BEST(for (j = 0; j < ARRAY_SIZE(Names); j++)
+                            Sink += strcmp(Names[j], key), iters * 20)
+           , strcmp(Names[0], key));
+    report("memset 128KiB unaligned"
+           , BENCH_BEST(memset(BufA + 1, 0x5a, BUFSIZE), iters)
+           , bench_hash(BufA, sizeof(BufA)));
+    report("memcpy 128KiB both unaligned"
+           , BENCH_BEST(memcpy(BufB + 1, BufA + 1, BUFSIZE), iters)
+           , bench_hash(BufB, sizeof(BufB)));
+    report("memcpy 128KiB mutually unaligned"
+           , BENCH_BEST(memcpy(BufB + 1, BufA + 2, BUFSIZE), iters)
+           , bench_hash(BufB, sizeof(BufB)));
+    return 0;
+}
@@ -0,0 +1,33 @@
+// Definitions for the host benchmarks in scripts/bench/.
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include "types.h" // u32
+
+// benchlib.c
+void bench_exit(int code) __noreturn;
+void bench_printf(const char *fmt, ...);
+u32 bench_now(void);
+void *bench_loadfile(const char *path, u32 *psize);
+u32 bench_heap_save(void);
+void bench_heap_restore(u32 pos);
+u32 bench_hash(const void *buf, u32 len);
+const char *bench_basename(const char *path);
+int bench_iterations(int argc, char **argv, int def);
+int bench_main(int argc, char **argv);
+
+// Run 'expr' 'iters' times and evaluate to the fastest run in ns.
+// The clock is a wrapping 32-bit counter, so runs must be under 4s.
+#define BENCH_BEST(expr, iters) ({                      \
+    u32 __best = ~0;                                    \
+    int __i;                                            \
+    for (__i = 0; __i < (iters); __i++) {               \
+        u32 __start = bench_now();                      \
+        expr;                                           \
+        u32 __t = bench_now() - __start;                \
+        if (__t < __best)                               \
+            __best = __t;                               \
+    }                                                   \
+    __best; })
+
+#endif // bench.h
@@ -0,0 +1,281 @@
+// Minimal runtime for running SeaBIOS code as a 32-bit Linux program.
+//
+// The benchmarks are built with the same code generation flags as the
+// 32bit flat mode parts of the rom, so no C library is available.
+// This file provides the few system calls, the output and the stubs
+// (malloc, yield) that the code under test needs.
+//
+// This file may be distributed under the terms of the GNU LGPLv3 license.
+
+#include <stdarg.h> // va_list
+#include "bench.h" // bench_printf
+#include "malloc.h" // _malloc
+#include "stacks.h" // yield
+#include "string.h" // strlen
+
+
+/****************************************************************
+ * System calls
+ ****************************************************************/
+
+#define SYS_exit            1
+#define SYS_read            3
+#define SYS_write           4
+#define SYS_open            5
+#define SYS_close           6
+#define SYS_clock_gettime   265
+
+#define CLOCK_MONOTONIC     1
+
+static int
+syscall3(int nr, u32 a, u32 b, u32 c)
+{
+    int ret;
+    asm volatile("int $0x80"
+                 : "=a"(ret) : "a"(nr), "b"(a), "c"(b), "d"(c) : "memory");
+    return ret;
+}
+
+void
+bench_exit(int code)
+{
+    for (;;)
+        syscall3(SYS_exit, code, 0, 0);
+}
+
+u32
+bench_now(void)
+{
+    struct { u32 sec, nsec; } ts;
+    syscall3(SYS_clock_gettime, CLOCK_MONOTONIC, (u32)&ts, 0);
+    return ts.sec * 1000000000 + ts.nsec;
+}
+
+// Program entry point - the kernel leaves argc and argv on the stack.
+asm(
+    "    .globl _start\n"
+    "_start:\n"
+    "    movl (%esp), %eax\n"
+    "    leal 4(%esp), %edx\n"
+    "    andl $-16, %esp\n"
+    "    calll bench_start\n"
+    );
+
+// Parse a "-n <iterations>" option (removing it from argv).
+int
+bench_iterations(int argc, char **argv, int def)
+{
+    int i;
+    for (i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-n"))
+            continue;
+        const char *p = argv[i + 1];
+        def = 0;
+        while (*p >= '0' && *p <= '9')
+            def = def * 10 + *p++ - '0';
+        argv[i] = argv[i + 1] = NULL;
+        break;
+    }
+    return def > 0 ? def : 1;
+}
+
+void __noreturn __VISIBLE
+bench_start(int argc, char **argv)
+{
+    bench_exit(bench_main(argc, argv));
+}
+
+
+/****************************************************************
+ * Output
+ ****************************************************************/
+
+static char OutBuf[256];
+static int OutPos;
+
+static void
+bench_flush(void)
+{
+    syscall3(SYS_write, 1, (u32)OutBuf, OutPos);
+    OutPos = 0;
+}
+
+static void
+bench_putc(char c)
+{
+    OutBuf[OutPos++] = c;
+    if (c == '\n' || OutPos == sizeof(OutBuf))
+        bench_flush();
+}
+
+static void
+bench_putuint(u32 val, int width)
+{
+    char buf[12];
+    char *d = &buf[sizeof(buf) - 1];
+    *d = '\0';
+    do {
+        *--d = '0' + val % 10;
+        val /= 10;
+    } while (val);
+    while (--width >= (int)(&buf[sizeof(buf) - 1] - d))
+        bench_putc(' ');
+    while (*d)
+        bench_putc(*d++);
+}
+
+// Supports %s, %d, %u and %x with an optional field width, plus %t
+// which prints a time in ns as microseconds.
+void
+bench_printf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    for (; *fmt; fmt++) {
+        if (*fmt != '%') {
+            bench_putc(*fmt);
+            continue;
+        }
+        int width = 0;
+        while (*++fmt >= '0' && *fmt <= '9')
+            width = width * 10 + *fmt - '0';
+        switch (*fmt) {
+        case 's': {
+            const char *s = va_arg(args, const char *);
+            width -= strlen(s);
+            while (*s)
+                bench_putc(*s++);
+            while (width-- > 0)
+                bench_putc(' ');
+            break;
+        }
+        case 'd': {
+            int val = va_arg(args, int);
+            if (val < 0) {
+                bench_putc('-');
+                val = -val;
+                width--;
+            }
+            bench_putuint(val, width);
+            break;
+        }
+        case 'u':
+            bench_putuint(va_arg(args, u32), width);
+            break;
+        case 'x': {
+            u32 val = va_arg(args, u32);
+            int i;
+            for (i = 28; i >= 0; i -= 4)
+                bench_putc("0123456789abcdef"[(val >> i) & 0xf]);
+            break;
+        }
+        case 't': {
+            u32 ns = va_arg(args, u32);
+            bench_putuint(ns / 1000, width > 3 ? width - 3 : 0);
+            bench_putc('.');
+            bench_putuint((ns / 100) % 10, 0);
+            bench_putuint((ns / 10) % 10, 0);
+            break;
+        }
+        default:
+            bench_putc(*fmt);
+            break;
+        }
+    }
+    va_end(args);
+    if (OutPos)
+        bench_flush();
+}
+
+// FNV-1a hash, used to check that two builds produce the same output.
+u32
+bench_hash(const void *buf, u32 len)
+{
+    const u8 *p = buf;
+    u32 hash = 2166136261;
+    while (len--)
+        hash = (hash ^ *p++) * 16777619;
+    return hash;
+}
+
+// Return the file name part of a path.
+const char *
+bench_basename(const char *path)
+{
+    const char *p = path;
+    while (*p)
+        if (*p++ == '/')
+            path = p;
+    return path;
+}
+
+
+/****************************************************************
+ * Memory
+ ****************************************************************/
+
+struct zone_s {
+    int unused;
+};
+struct zone_s ZoneLow, ZoneHigh, ZoneFSeg, ZoneTmpLow, ZoneTmpHigh;
+
+static u8 Heap[96*1024*1024] __aligned(4096);
+static u32 HeapPos;
+
+// Simple bump allocator - memory is only reused via bench_heap_restore().
+void *
+_malloc(struct zone_s *zone, u32 size, u32 align)
+{
+    u32 pos = ALIGN(HeapPos, align);
+    if (pos + size > sizeof(Heap))
+        return NULL;
+    HeapPos = pos + size;
+    return &Heap[pos];
+}
+
+void
+free(void *data)
+{
+}
+
+// Release everything allocated since bench_heap_save().
+u32
+bench_heap_save(void)
+{
+    return HeapPos;
+}
+
+void
+bench_heap_restore(u32 pos)
+{
+    HeapPos = pos;
+}
+
+void
+yield(void)
+{
+}
+
+// Read a whole file into memory.
+void *
+bench_loadfile(const char *path, u32 *psize)
+{
+    int fd = syscall3(SYS_open, (u32)path, 0, 0);
+    if (fd < 0) {
+        bench_printf("Unable to open %s\n", path);
+        bench_exit(1);
+    }
+    u8 *data = &Heap[ALIGN(HeapPos, MALLOC_MIN_ALIGN)];
+    u32 size = 0;
+    for (;;) {
+        u32 space = sizeof(Heap) - (data - Heap) - size;
+        int ret = syscall3(SYS_read, fd, (u32)data + size, space);
+        if (ret <= 0)
+            break;
+        size += ret;
+    }
+    syscall3(SYS_close, fd, 0, 0);
+    HeapPos = data - Heap + size;
+    *psize = size;
+    return data;
+}
@@ -0,0 +1,387 @@
+// Generate a synthetic boot splash JPEG for scripts/bench/bench-jpeg.
+//
+// Usage: mkjpeg <width> <height> <420|444> <outfile>
+//
+// Writes a baseline (sequential, huffman) JPEG using the example
+// tables from the JPEG standard at quality 90.  The picture is a
+// colour gradient with some shapes and noise, roughly matching the
+// size and entropy of a photographic splash.  This is a host tool and
+// is built with the host C library.
+//
+// This file may be distributed under the terms of the GNU LGPLv3 license.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUALITY 90
+
+static const unsigned char ZigZag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+static const unsigned char LumaQuant[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99,
+};
+
+static const unsigned char ChromaQuant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+// Huffman table specifications (JPEG standard, annex K.3)
+static const unsigned char DCLumaBits[16] = {
+    0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const unsigned char DCLumaVals[12] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const unsigned char DCChromaBits[16] = {
+    0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const unsigned char DCChromaVals[12] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const unsigned char ACLumaBits[16] = {
+    0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const unsigned char ACLumaVals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06,
+    0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+    0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45,
+    0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75,
+    0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+    0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+    0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+    0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4,
+    0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa,
+};
+static const unsigned char ACChromaBits[16] = {
+    0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const unsigned char ACChromaVals[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41,
+    0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1,
+    0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44,
+    0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74,
+    0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+    0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+    0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+    0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4,
+    0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa,
+};
+
+struct huffman {
+    unsigned short code[256];
+    unsigned char size[256];
+};
+
+static struct huffman DCLuma, DCChroma, ACLuma, ACChroma;
+static unsigned char Quant[2][64];
+static FILE *Out;
+static unsigned int BitBuf;
+static int BitCount;
+
+
+/****************************************************************
+ * Output
+ ****************************************************************/
+
+static void
+put8(int v)
+{
+    fputc(v, Out);
+}
+
+static void
+put16(int v)
+{
+    put8(v >> 8);
+    put8(v & 0xff);
+}
+
+static void
+putbits(unsigned int code, int size)
+{
+    BitBuf = (BitBuf << size) | (code & ((1 << size) - 1));
+    BitCount += size;
+    while (BitCount >= 8) {
+        int c = (BitBuf >> (BitCount - 8)) & 0xff;
+        put8(c);
+        if (c == 0xff)
+            // Byte stuffing
+            put8(0);
+        BitCount -= 8;
+    }
+}
+
+static void
+flushbits(void)
+{
+    if (BitCount)
+        putbits(0x7f, 8 - BitCount);
+}
+
+static void
+build_huffman(struct huffman *h, const unsigned char *bits
+              , const unsigned char *vals)
+{
+    int len, i, k = 0, code = 0;
+    for (len = 1; len <= 16; len++) {
+        for (i = 0; i < bits[len - 1]; i++, k++) {
+            h->code[vals[k]] = code++;
+            h->size[vals[k]] = len;
+        }
+        code <<= 1;
+    }
+}
+
+static void
+write_dht(int class_id, const unsigned char *bits, const unsigned char *vals)
+{
+    int i, count = 0;
+    for (i = 0; i < 16; i++)
+        count += bits[i];
+    put16(0xffc4);
+    put16(2 + 1 + 16 + count);
+    put8(class_id);
+    for (i = 0; i < 16; i++)
+        put8(bits[i]);
+    for (i = 0; i < count; i++)
+        put8(vals[i]);
+}
+
+static void
+write_headers(int width, int height, int luma_hv)
+{
+    int i, t;
+    put16(0xffd8);                      // SOI
+    put16(0xffdb);                      // DQT
+    put16(2 + 2 * 65);
+    for (t = 0; t < 2; t++) {
+        put8(t);
+        for (i = 0; i < 64; i++)
+            put8(Quant[t][ZigZag[i]]);
+    }
+    put16(0xffc0);                      // SOF0
+    put16(8 + 3 * 3);
+    put8(8);
+    put16(height);
+    put16(width);
+    put8(3);
+    put8(1); put8(luma_hv); put8(0);
+    put8(2); put8(0x11); put8(1);
+    put8(3); put8(0x11); put8(1);
+    write_dht(0x00, DCLumaBits, DCLumaVals);
+    write_dht(0x10, ACLumaBits, ACLumaVals);
+    write_dht(0x01, DCChromaBits, DCChromaVals);
+    write_dht(0x11, ACChromaBits, ACChromaVals);
+    put16(0xffda);                      // SOS
+    put16(6 + 2 * 3);
+    put8(3);
+    put8(1); put8(0x00);
+    put8(2); put8(0x11);
+    put8(3); put8(0x11);
+    put8(0); put8(63); put8(0);
+}
+
+
+/****************************************************************
+ * Encoding
+ ****************************************************************/
+
+static double CosTable[8][8];
+
+static void
+init_tables(void)
+{
+    int i, j;
+    int scale = QUALITY < 50 ? 5000 / QUALITY : 200 - QUALITY * 2;
+    for (i = 0; i < 64; i++) {
+        int q = (LumaQuant[i] * scale + 50) / 100;
+        Quant[0][i] = q < 1 ? 1 : q > 255 ? 255 : q;
+        q = (ChromaQuant[i] * scale + 50) / 100;
+        Quant[1][i] = q < 1 ? 1 : q > 255 ? 255 : q;
+    }
+    for (i = 0; i < 8; i++)
+        for (j = 0; j < 8; j++)
+            CosTable[i][j] = (i ? 0.5 : sqrt(0.125))
+                * cos((2 * j + 1) * i * M_PI / 16);
+    build_huffman(&DCLuma, DCLumaBits, DCLumaVals);
+    build_huffman(&DCChroma, DCChromaBits, DCChromaVals);
+    build_huffman(&ACLuma, ACLumaBits, ACLumaVals);
+    build_huffman(&ACChroma, ACChromaBits, ACChromaVals);
+}
+
+static int
+bitsize(int v)
+{
+    int n = 0;
+    if (v < 0)
+        v = -v;
+    while (v) {
+        n++;
+        v >>= 1;
+    }
+    return n;
+}
+
+static void
+putcoef(int v, int size)
+{
+    putbits(v < 0 ? v - 1 : v, size);
+}
+
+// Transform, quantize and entropy code one 8x8 block of samples.
+static void
+encode_block(const double *samples, const unsigned char *quant
+             , struct huffman *dc, struct huffman *ac, int *pred)
+{
+    double tmp[64];
+    int coef[64];
+    int u, v, x;
+    for (v = 0; v < 8; v++)
+        for (u = 0; u < 8; u++) {
+            double s = 0;
+            for (x = 0; x < 8; x++)
+                s += CosTable[u][x] * samples[v * 8 + x];
+            tmp[v * 8 + u] = s;
+        }
+    for (v = 0; v < 8; v++)
+        for (u = 0; u < 8; u++) {
+            double s = 0;
+            for (x = 0; x < 8; x++)
+                s += CosTable[v][x] * tmp[x * 8 + u];
+            coef[v * 8 + u] = lround(s / quant[v * 8 + u]);
+        }
+
+    int diff = coef[0] - *pred;
+    *pred = coef[0];
+    int size = bitsize(diff);
+    putbits(dc->code[size], dc->size[size]);
+    putcoef(diff, size);
+
+    int i, run = 0;
+    for (i = 1; i < 64; i++) {
+        int c = coef[ZigZag[i]];
+        if (!c) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            putbits(ac->code[0xf0], ac->size[0xf0]);
+            run -= 16;
+        }
+        size = bitsize(c);
+        int sym = (run << 4) | size;
+        putbits(ac->code[sym], ac->size[sym]);
+        putcoef(c, size);
+        run = 0;
+    }
+    if (run)
+        putbits(ac->code[0x00], ac->size[0x00]);
+}
+
+// Synthetic picture: diagonal gradient, a few discs and some noise.
+static void
+make_pixel(int x, int y, int width, int height, double *ycc)
+{
+    static unsigned int seed = 12345;
+    double r = 40 + 160.0 * x / width, g = 60 + 120.0 * y / height;
+    double b = 200 - 150.0 * (x + y) / (width + height);
+    int i;
+    for (i = 0; i < 5; i++) {
+        int cx = width * (i + 1) / 6, cy = height / 2 + (i & 1 ? 1 : -1)
+            * height / 6;
+        int rad = height / (5 + i);
+        if ((x - cx) * (x - cx) + (y - cy) * (y - cy) < rad * rad) {
+            r = 255 - r;
+            g = (g + 60 * i) > 255 ? 255 : g + 60 * i;
+        }
+    }
+    seed = seed * 1103515245 + 12345;
+    double noise = (double)((seed >> 16) & 3) - 1.5;
+    r += noise;
+    g += noise;
+    b += noise;
+    ycc[0] = 0.299 * r + 0.587 * g + 0.114 * b - 128;
+    ycc[1] = -0.168736 * r - 0.331264 * g + 0.5 * b;
+    ycc[2] = 0.5 * r - 0.418688 * g - 0.081312 * b;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 5) {
+        fprintf(stderr, "Usage: %s <width> <height> <420|444> <outfile>\n"
+                , argv[0]);
+        return 1;
+    }
+    int width = atoi(argv[1]), height = atoi(argv[2]);
+    int sub = !strcmp(argv[3], "420") ? 2 : 1;
+    if (width <= 0 || height <= 0 || width % (8 * sub)
+        || height % (8 * sub)) {
+        fprintf(stderr, "Size must be a multiple of the %d pixel MCU\n"
+                , 8 * sub);
+        return 1;
+    }
+    Out = fopen(argv[4], "wb");
+    if (!Out) {
+        perror(argv[4]);
+        return 1;
+    }
+    init_tables();
+    write_headers(width, height, sub == 2 ? 0x22 : 0x11);
+
+    double *pixels = malloc(sizeof(double) * 3 * width * height);
+    int x, y, c, i, j;
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+            make_pixel(x, y, width, height, &pixels[(y * width + x) * 3]);
+
+    int mcu = 8 * sub, pred[3] = { 0, 0, 0 };
+    double block[64];
+    for (y = 0; y < height; y += mcu)
+        for (x = 0; x < width; x += mcu) {
+            // Luma blocks
+            for (j = 0; j < sub; j++)
+                for (i = 0; i < sub; i++) {
+                    int k;
+                    for (k = 0; k < 64; k++)
+                        block[k] = pixels[((y + j * 8 + k / 8) * width
+                                           + x + i * 8 + k % 8) * 3];
+                    encode_block(block, Quant[0], &DCLuma, &ACLuma, &pred[0]);
+                }
+            // Chroma blocks (averaged over the MCU when subsampled)
+            for (c = 1; c < 3; c++) {
+                int k;
+                for (k = 0; k < 64; k++) {
+                    double s = 0;
+                    for (j = 0; j < sub; j++)
+                        for (i = 0; i < sub; i++)
+                            s += pixels[((y + (k / 8) * sub + j) * width
+                                         + x + (k % 8) * sub + i) * 3 + c];
+                    block[k] = s / (sub * sub);
+                }
+                encode_block(block, Quant[1], &DCChroma, &ACChroma, &pred[c]);
+            }
+        }
+    flushbits();
+    put16(0xffd9);                      // EOI
+    fclose(Out);
+    free(pixels);
+    return 0;
+}
@@ -0,0 +1,24 @@
+#!/usr/bin/env python3
+# Compress a file the way cbfstool does, for scripts/bench/bench-lzma.
+#
+# This file may be distributed under the terms of the GNU GPLv3 license.
+
+# Usage:
+#   scripts/bench/mklzma.py out/bios.bin.raw out/bench/bios.lzma
+
+import sys, lzma, struct
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write("Usage: %s <infile> <outfile>\n" % (sys.argv[0],))
+        sys.exit(1)
+    data = open(sys.argv[1], 'rb').read()
+    # cbfstool uses lc=3 lp=0 pb=2 and records the uncompressed size
+    filters = [{'id': lzma.FILTER_LZMA1, 'lc': 3, 'lp': 0, 'pb': 2,
+                'dict_size': 1 << 20}]
+    comp = lzma.compress(data, format=lzma.FORMAT_ALONE, filters=filters)
+    comp = comp[:5] + struct.pack('<Q', len(data)) + comp[13:]
+    open(sys.argv[2], 'wb').write(comp)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,189 @@
+#!/usr/bin/env python
+# Decode the SeaBIOS binary trace buffer (see CONFIG_DEBUG_TRACE).
+#
+# This file may be distributed under the terms of the GNU GPLv3 license.
+
+# Usage:
+#   scripts/readtrace.py out/rom.o seabios.log
+#   scripts/readtrace.py -m 0x7fff0000 out/rom.o memory.dump
+#
+# The first form decodes the "trace:" lines written to the debug log
+# on a panic.  The second searches a raw memory dump (starting at the
+# given physical address) for the trace buffer itself.
+
+import sys, re, struct, optparse
+
+TRACE_SIGNATURE = 0x45435254
+TRACE_ENTRY_SIZE = 5 * 4
+
+PT_LOAD = 1
+
+
+######################################################################
+# String lookup in the linked rom image
+######################################################################
+
+class RomImage:
+    def __init__(self, filename):
+        f = open(filename, 'rb')
+        self.data = f.read()
+        f.close()
+        if self.data[:4] != b'\x7fELF':
+            raise ValueError("%s is not an ELF file" % (filename,))
+        phoff, = struct.unpack_from('<I', self.data, 0x1c)
+        phentsize, phnum = struct.unpack_from('<HH', self.data, 0x2a)
+        self.segments = []
+        for i in range(phnum):
+            (ptype, offset, vaddr, paddr, filesz, memsz, flags, align
+             ) = struct.unpack_from('<8I', self.data, phoff + i*phentsize)
+            if ptype == PT_LOAD and filesz:
+                self.segments.append((vaddr, filesz, offset))
+        self.delta = 0
+
+    def lookup(self, addr):
+        for a in (addr, addr - self.delta):
+            for vaddr, filesz, offset in self.segments:
+                if vaddr <= a < vaddr + filesz:
+                    pos = offset + a - vaddr
+                    end = self.data.find(b'\0', pos, offset + filesz)
+                    if end < 0:
+                        end = offset + filesz
+                    return self.data[pos:end].decode('latin-1')
+        return None
+
+
+######################################################################
+# Format string expansion
+######################################################################
+
+RE_FORMAT = re.compile(r'%(0?)([0-9]*)(l*)([a-zA-Z%])')
+
+def sformat(rom, fmt, args):
+    args = list(args)
+    out = []
+    pos = 0
+    for m in RE_FORMAT.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        pad, width, conv = m.group(1), m.group(2), m.group(4)
+        if conv == '%':
+            out.append('%')
+            continue
+        val = args.pop(0) if args else 0
+        if conv == 'p' and fmt[pos:pos+1] == 'P':
+            # PCI device pointer - only the address is known offline
+            pos += 1
+            out.append('pci@%08x' % (val,))
+            continue
+        if conv in 'di':
+            if val & 0x80000000:
+                val -= 1 << 32
+            s = '%d' % (val,)
+        elif conv == 'u':
+            s = '%u' % (val,)
+        elif conv in 'xX':
+            s = '%x' % (val,)
+        elif conv == 'p':
+            s = '0x%08x' % (val,)
+        elif conv == 'c':
+            s = chr(val & 0xff)
+        elif conv == 's':
+            s = rom.lookup(val)
+            if s is None:
+                s = '<%08x>' % (val,)
+        else:
+            s = m.group(0)
+        if width:
+            w = int(width)
+            if pad:
+                s = s.rjust(w, '0')
+            else:
+                s = s.rjust(w)
+        out.append(s)
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+def show_entry(rom, index, entry):
+    fmt = rom.lookup(entry[0])
+    if fmt is None:
+        line = "<unknown format %08x> %08x %08x %08x %08x\n" % tuple(entry)
+    else:
+        line = sformat(rom, fmt, entry[1:])
+        if not line.endswith('\n'):
+            line += '\n'
+    sys.stdout.write("%6d: %s" % (index, line))
+
+
+######################################################################
+# Trace sources
+######################################################################
+
+RE_HEADER = re.compile(r'trace: count=([0-9]+) size=([0-9]+)'
+                       r' delta=([0-9a-f]+)')
+RE_ENTRY = re.compile(r'trace: ([0-9a-f]+) ([0-9a-f]+) ([0-9a-f]+)'
+                      r' ([0-9a-f]+) ([0-9a-f]+)')
+
+def read_log(rom, filename):
+    f = open(filename, 'rb')
+    lines = f.read().decode('latin-1').split('\n')
+    f.close()
+    index = 0
+    for line in lines:
+        m = RE_HEADER.search(line)
+        if m is not None:
+            count, size = int(m.group(1)), int(m.group(2))
+            delta = int(m.group(3), 16)
+            if delta & 0x80000000:
+                delta -= 1 << 32
+            rom.delta = delta
+            index = max(0, count - size)
+            sys.stdout.write("======= trace (%d events)\n" % (count,))
+            continue
+        m = RE_ENTRY.search(line)
+        if m is not None:
+            show_entry(rom, index, [int(g, 16) for g in m.groups()])
+            index += 1
+
+def read_dump(rom, filename, base):
+    f = open(filename, 'rb')
+    data = f.read()
+    f.close()
+    sig = struct.pack('<I', TRACE_SIGNATURE)
+    pos = data.find(sig)
+    while pos >= 0:
+        if not pos & 3:
+            count, size, delta = struct.unpack_from('<IIi', data, pos + 4)
+            end = pos + 16 + size * TRACE_ENTRY_SIZE
+            if size and end <= len(data):
+                break
+        pos = data.find(sig, pos + 1)
+    if pos < 0:
+        sys.stderr.write("Trace buffer not found\n")
+        return -1
+    rom.delta = delta
+    sys.stdout.write("======= trace at %08x (%d events)\n" % (
+        base + pos, count))
+    first = max(0, count - size)
+    for i in range(first, count):
+        entry = struct.unpack_from(
+            '<5I', data, pos + 16 + (i % size) * TRACE_ENTRY_SIZE)
+        show_entry(rom, i, entry)
+    return 0
+
+def main():
+    usage = "%prog [options] <rom.o> <logfile|memdump>"
+    opts = optparse.OptionParser(usage)
+    opts.add_option("-m", "--memdump", type="string", dest="base",
+                    default=None,
+                    help="input is a raw memory dump starting at BASE")
+    options, args = opts.parse_args()
+    if len(args) != 2:
+        opts.error("Incorrect number of arguments")
+    rom = RomImage(args[0])
+    if options.base is not None:
+        return read_dump(rom, args[1], int(options.base, 0))
+    read_log(rom, args[1])
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -622,6 +622,8 @@ process_op(struct disk_op_s *op)
     dprintf(DEBUG_HDL_13, "disk_op d=%p lba=%d buf=%p count=%d cmd=%d\n"
             , op->drive_fl, (u32)op->lba, op->buf_fl
             , op->count, op->command);
+    dtrace("disk_op d=%p lba=%u count=%d cmd=%d\n"
+           , op->drive_fl, (u32)op->lba, op->count, op->command);
 
     int ret, origcount = op->count;
     if (origcount * GET_FLATPTR(op->drive_fl->blksize) > 64*1024) {
@@ -635,5 +637,6 @@ process_op(struct disk_op_s *op)
     if (ret && op->count == origcount)
         // If the count hasn't changed on error, assume no data transferred.
         op->count = 0;
+    dtrace("disk_op d=%p ret=%d count=%d\n", op->drive_fl, ret, op->count);
     return ret;
 }
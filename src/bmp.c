@@ -7,17 +7,29 @@
 * This work is licensed under the terms of the GNU LGPLv3.
 */
 #include "malloc.h" // malloc_tmphigh
+#include "stacks.h" // yield
 #include "string.h" // memcpy
 #include "util.h" // struct bmp_decdata
+#include "x86.h" // __ffs
 
 struct bmp_decdata {
     struct tagRGBQUAD *quadp;
     unsigned char *datap;
+    unsigned char *endp;
     int width;
     int height;
+    int topdown;
     int bpp;
+    int compression;
+    int palsize;
+    u32 masks[3];
 };
 
+#define BI_RGB       0
+#define BI_RLE8      1
+#define BI_RLE4      2
+#define BI_BITFIELDS 3
+
 #define bmp_load4byte(addr) (*(u32 *)(addr))
 #define bmp_load2byte(addr) (*(u16 *)(addr))
 
@@ -50,22 +62,193 @@ typedef struct tagRGBQUAD {
     u8 rgbReserved;
 } RGBQUAD, tagRGBQUAD;
 
+/* bytes of one (4 byte aligned) source line */
+static int bmp_stride(struct bmp_decdata *bmp)
+{
+    return ((bmp->width * bmp->bpp + 31) / 32) * 4;
+}
+
+/* destination line of source line 'y' (bmp lines are bottom-up) */
+static u8 *bmp_destline(struct bmp_decdata *bmp, u8 *pic, int y,
+                        int bytes_per_line_dest)
+{
+    if (!bmp->topdown)
+        y = bmp->height - 1 - y;
+    return pic + y * bytes_per_line_dest;
+}
+
+/* is the pixel data in the framebuffer format for 'bpp'? */
+static int bmp_is_direct(struct bmp_decdata *bmp)
+{
+    switch (bmp->compression) {
+    case BI_RGB:
+        return bmp->bpp == 24 || bmp->bpp == 32;
+    case BI_BITFIELDS:
+        if (bmp->bpp == 16)
+            return (bmp->masks[0] == 0xf800 && bmp->masks[1] == 0x07e0
+                    && bmp->masks[2] == 0x001f);
+        return (bmp->masks[0] == 0xff0000 && bmp->masks[1] == 0x00ff00
+                && bmp->masks[2] == 0x0000ff);
+    }
+    return 0;
+}
+
 /* flat picture data adjusting function
 * description:
 *   switch the vertical line sequence
 *   arrange horizontal pixel data, add extra space in the dest buffer
 *       for every line
 */
-static void raw_data_format_adjust(u8 *src, u8 *dest, int width,
-		int height, int bytes_per_line_src, int bytes_per_line_dest)
+static void raw_data_format_adjust(struct bmp_decdata *bmp, u8 *dest,
+                                   int bytes_per_line_dest)
 {
+    int bytes_per_line_src = bmp_stride(bmp);
+    int len = bmp->width * bmp->bpp / 8;
     int i;
-    for (i = 0 ; i < height ; i++) {
-        memcpy(dest + i * bytes_per_line_dest,
-           src + (height - 1 - i) * bytes_per_line_src, bytes_per_line_src);
+    for (i = 0 ; i < bmp->height ; i++) {
+        iomemcpy(bmp_destline(bmp, dest, i, bytes_per_line_dest),
+                 bmp->datap + i * bytes_per_line_src, len);
+        yield();
+    }
+}
+
+/* store a 0x00RRGGBB colour in the framebuffer format for 'depth' */
+static void bmp_putpixel(u8 *p, int depth, u32 rgb)
+{
+    switch (depth) {
+    case 32:
+        *(u32*)p = rgb;
+        break;
+    case 24:
+        p[0] = rgb;
+        p[1] = rgb >> 8;
+        p[2] = rgb >> 16;
+        break;
+    default:
+        *(u16*)p = (((rgb >> 8) & 0xf800) | ((rgb >> 5) & 0x07e0)
+                    | ((rgb >> 3) & 0x001f));
+        break;
     }
 }
 
+static u32 bmp_palette(struct bmp_decdata *bmp, int index)
+{
+    if (index >= bmp->palsize)
+        return 0;
+    struct tagRGBQUAD *q = &bmp->quadp[index];
+    return (q->rgbRed << 16) | (q->rgbGreen << 8) | q->rgbBlue;
+}
+
+/* scale the colour component selected by 'mask' to 8 bits */
+static u32 bmp_component(u32 val, u32 mask)
+{
+    if (!mask)
+        return 0;
+    int shift = __ffs(mask), bits = __fls(mask) - shift + 1;
+    val = (val & mask) >> shift;
+    if (bits >= 8)
+        return val >> (bits - 8);
+    // Replicate the top bits so full intensity maps to 0xff
+    val <<= 8 - bits;
+    return val | (val >> bits);
+}
+
+/* convert an uncompressed source line to the framebuffer format */
+static void bmp_convert_line(struct bmp_decdata *bmp, u8 *src, u8 *dest,
+                             int depth)
+{
+    int bytes_per_pixel = depth / 8;
+    u32 masks[3] = { 0x7c00, 0x03e0, 0x001f };
+    if (bmp->compression == BI_BITFIELDS)
+        memcpy(masks, bmp->masks, sizeof(masks));
+    int x;
+    for (x = 0; x < bmp->width; x++, dest += bytes_per_pixel) {
+        u32 rgb, val;
+        switch (bmp->bpp) {
+        case 1:
+            rgb = bmp_palette(bmp, (src[x >> 3] >> (7 - (x & 7))) & 1);
+            break;
+        case 4:
+            rgb = bmp_palette(bmp, (src[x >> 1] >> ((x & 1) ? 0 : 4)) & 0xf);
+            break;
+        case 8:
+            rgb = bmp_palette(bmp, src[x]);
+            break;
+        case 24:
+            rgb = src[x*3] | (src[x*3 + 1] << 8) | (src[x*3 + 2] << 16);
+            break;
+        default:
+            if (bmp->bpp == 16)
+                val = *(u16*)&src[x*2];
+            else
+                val = *(u32*)&src[x*4];
+            rgb = ((bmp_component(val, masks[0]) << 16)
+                   | (bmp_component(val, masks[1]) << 8)
+                   | bmp_component(val, masks[2]));
+            break;
+        }
+        bmp_putpixel(dest, depth, rgb);
+    }
+}
+
+/* decode BI_RLE8 / BI_RLE4 data; skipped pixels are left black */
+static int bmp_rle_decode(struct bmp_decdata *bmp, u8 *pic, int depth,
+                          int bytes_per_line_dest)
+{
+    int bytes_per_pixel = depth / 8, rle4 = bmp->compression == BI_RLE4;
+    u8 *p = bmp->datap, *end = bmp->endp;
+    int x = 0, y = 0, i;
+    for (i = 0; i < bmp->height; i++)
+        memset(pic + i * bytes_per_line_dest, 0
+               , bmp->width * bytes_per_pixel);
+    while (p + 2 <= end && y < bmp->height) {
+        u8 count = *p++, val = *p++;
+        u8 *line = bmp_destline(bmp, pic, y, bytes_per_line_dest);
+        if (count) {
+            // Encoded run
+            for (i = 0; i < count && x < bmp->width; i++, x++) {
+                int index = rle4 ? ((i & 1) ? val & 0xf : val >> 4) : val;
+                bmp_putpixel(line + x * bytes_per_pixel, depth
+                             , bmp_palette(bmp, index));
+            }
+            continue;
+        }
+        switch (val) {
+        case 0:
+            // End of line
+            x = 0;
+            y++;
+            yield();
+            break;
+        case 1:
+            // End of bitmap
+            return 0;
+        case 2:
+            // Delta
+            if (p + 2 > end)
+                return 1;
+            x += p[0];
+            y += p[1];
+            p += 2;
+            break;
+        default: {
+            // Absolute run, padded to a 16 bit boundary
+            int len = rle4 ? (val + 1) / 2 : val;
+            if (p + len > end)
+                return 1;
+            for (i = 0; i < val && x < bmp->width; i++, x++) {
+                int index = rle4 ? ((i & 1) ? p[i/2] & 0xf : p[i/2] >> 4) : p[i];
+                bmp_putpixel(line + x * bytes_per_pixel, depth
+                             , bmp_palette(bmp, index));
+            }
+            p += ALIGN(len, 2);
+            break;
+        }
+        }
+    }
+    return 0;
+}
+
 /* allocate decdata struct */
 struct bmp_decdata *bmp_alloc(void)
 {
@@ -86,31 +269,101 @@ int bmp_decode(struct bmp_decdata *bmp, unsigned char *data, int data_size)
     if (bmp_recordsize != data_size)
         return 3;
     u32 bmp_dataoffset = bmp_load4byte(data + 10);
+    u32 bmp_headersize = bmp_load4byte(data + 14);
+    if (bmp_dataoffset >= data_size || bmp_headersize < 40
+        || 14 + bmp_headersize > bmp_dataoffset)
+        return 4;
     bmp->datap = (unsigned char *)data + bmp_dataoffset;
+    bmp->endp = (unsigned char *)data + data_size;
     bmp->width = bmp_load4byte(data + 18);
     bmp->height = bmp_load4byte(data + 22);
+    bmp->topdown = bmp->height < 0;
+    if (bmp->topdown)
+        bmp->height = -bmp->height;
     bmp->bpp = bmp_load2byte(data + 28);
+    bmp->compression = bmp_load4byte(data + 30);
+    bmp->quadp = (struct tagRGBQUAD *)(data + 14 + bmp_headersize);
+    memset(bmp->masks, 0, sizeof(bmp->masks));
+    if (bmp->compression == BI_BITFIELDS) {
+        // The colour masks directly follow the 40 byte info header (both
+        // for BITMAPINFOHEADER + masks and for the V2+ headers).
+        if (54 + sizeof(bmp->masks) > bmp_dataoffset)
+            return 4;
+        memcpy(bmp->masks, data + 54, sizeof(bmp->masks));
+        if (bmp_headersize == 40)
+            bmp->quadp = (struct tagRGBQUAD *)(data + 54
+                                               + sizeof(bmp->masks));
+    }
+    bmp->palsize = 0;
+    if (bmp->bpp <= 8) {
+        u32 clrused = bmp_load4byte(data + 46);
+        if (!clrused || clrused > (1 << bmp->bpp))
+            clrused = 1 << bmp->bpp;
+        u32 maxpal = ((u8*)bmp->datap - (u8*)bmp->quadp) / sizeof(RGBQUAD);
+        bmp->palsize = clrused < maxpal ? clrused : maxpal;
+    }
+    if (bmp->width <= 0 || !bmp->height)
+        return 4;
+
+    switch (bmp->compression) {
+    case BI_RGB:
+        if (bmp->bpp != 1 && bmp->bpp != 4 && bmp->bpp != 8
+            && bmp->bpp != 16 && bmp->bpp != 24 && bmp->bpp != 32)
+            return 5;
+        break;
+    case BI_RLE8:
+    case BI_RLE4:
+        if (bmp->bpp != (bmp->compression == BI_RLE8 ? 8 : 4)
+            || bmp->topdown)
+            return 5;
+        return 0;
+    case BI_BITFIELDS:
+        if (bmp->bpp != 16 && bmp->bpp != 32)
+            return 5;
+        break;
+    default:
+        return 5;
+    }
+    if (bmp->endp - bmp->datap < bmp_stride(bmp) * bmp->height)
+        return 6;
     return 0;
 }
 
-/* get bmp properties */
+/* get bmp properties
+ * bpp is the required video mode depth, or 0 if the image is
+ * converted to whatever 16/24/32 bpp mode is available. */
 void bmp_get_info(struct bmp_decdata *bmp, int *width, int *height, int *bpp)
 {
     *width = bmp->width;
     *height = bmp->height;
-    *bpp = bmp->bpp;
+    *bpp = bmp_is_direct(bmp) ? bmp->bpp : 0;
 }
 
-/* flush flat picture data to *pc */
+/* flush flat picture data to *pc
+ * 'pic' may be the framebuffer itself; images already in the mode's
+ * pixel format are copied line by line without conversion. */
 int bmp_show(struct bmp_decdata *bmp, unsigned char *pic, int width,
              int height, int depth, int bytes_per_line_dest)
 {
     if (bmp->datap == pic)
         return 0;
-    if ((depth == bmp->bpp) && (bmp->bpp%8 == 0)) {
-        raw_data_format_adjust(bmp->datap, pic, width, height,
-			(bmp->bpp/8)*width, bytes_per_line_dest);
+    if (width != bmp->width || height != bmp->height)
+        return 1;
+    if (depth != 16 && depth != 24 && depth != 32)
+        return 1;
+    if (bmp_is_direct(bmp) && depth == bmp->bpp) {
+        raw_data_format_adjust(bmp, pic, bytes_per_line_dest);
         return 0;
     }
-    return 1;
+    if (bmp->compression == BI_RLE8 || bmp->compression == BI_RLE4)
+        return bmp_rle_decode(bmp, pic, depth, bytes_per_line_dest);
+    int bytes_per_line_src = bmp_stride(bmp);
+    int i;
+    for (i = 0 ; i < bmp->height ; i++) {
+        bmp_convert_line(bmp, bmp->datap + i * bytes_per_line_src
+                         , bmp_destline(bmp, pic, i, bytes_per_line_dest)
+                         , depth);
+        yield();
+    }
+    return 0;
 }
@@ -36,6 +36,49 @@ call16_int10(struct bregs *br)
  * VGA text / graphics console
  ****************************************************************/
 
+// Map the VBE linear framebuffer write-combining for the rest of POST.
+static void
+framebuffer_wc_setup(void)
+{
+    if (!CONFIG_MTRR_WC_FRAMEBUFFER)
+        return;
+    struct vbe_info *vesa_info = malloc_tmplow(sizeof(*vesa_info));
+    struct vbe_mode_info *mode_info = malloc_tmplow(sizeof(*mode_info));
+    if (!vesa_info || !mode_info) {
+        warn_noalloc();
+        goto done;
+    }
+    memset(vesa_info, 0, sizeof(*vesa_info));
+    vesa_info->signature = VBE2_SIGNATURE;
+    struct bregs br;
+    memset(&br, 0, sizeof(br));
+    br.ax = 0x4f00;
+    br.di = FLATPTR_TO_OFFSET(vesa_info);
+    br.es = FLATPTR_TO_SEG(vesa_info);
+    call16_int10(&br);
+    if (br.ax != 0x4f || vesa_info->signature != VESA_SIGNATURE)
+        goto done;
+
+    // All linear modes share one framebuffer - use the first one found.
+    u16 *videomodes = SEGOFF_TO_FLATPTR(vesa_info->video_mode);
+    for (; *videomodes != 0xffff; videomodes++) {
+        memset(&br, 0, sizeof(br));
+        br.ax = 0x4f01;
+        br.cx = *videomodes;
+        br.di = FLATPTR_TO_OFFSET(mode_info);
+        br.es = FLATPTR_TO_SEG(mode_info);
+        call16_int10(&br);
+        if (br.ax != 0x4f || !(mode_info->mode_attributes
+                               & VBE_MODE_ATTRIBUTE_LINEAR_FRAME_BUFFER_MODE))
+            continue;
+        mtrr_wc_setup(mode_info->phys_base, vesa_info->total_memory << 16);
+        break;
+    }
+done:
+    free(vesa_info);
+    free(mode_info);
+}
+
 void
 enable_vga_console(void)
 {
@@ -47,6 +90,8 @@ enable_vga_console(void)
     br.ax = 0x0003;
     call16_int10(&br);
 
+    framebuffer_wc_setup();
+
     // Write to screen.
     printf("SeaBIOS (version %s)\n", VERSION);
     display_uuid();
@@ -92,34 +137,97 @@ find_videomode(struct vbe_info *vesa_info, struct vbe_mode_info *mode_info
     }
 }
 
+/****************************************************************
+ * Boot splash image
+ ****************************************************************/
+
+// The splash image is parsed and the video mode selected early (on
+// the main POST path), but the pixel data is decoded into an
+// off-screen buffer by a background thread so that it overlaps with
+// hardware initialization (the decoders yield every row so the other
+// init threads keep running).  Only the mode set and blit are done
+// when the splash is actually displayed.
+
+#define SPLASH_NONE     0
+#define SPLASH_DECODING 1
+#define SPLASH_READY    2
+#define SPLASH_FAILED   3
+
+static struct {
+    int state;
+    u8 type; /* 0 means jpg, 1 means bmp */
+    u8 *filedata;
+    struct jpeg_decdata *jpeg;
+    struct bmp_decdata *bmp;
+    u8 *picture;
+    void *framebuffer;
+    int videomode, width, height, depth, bytes_per_scanline;
+} Splash;
+
 static int BootsplashActive;
 
+static void
+bootsplash_free(void)
+{
+    free(Splash.filedata);
+    free(Splash.picture);
+    free(Splash.jpeg);
+    free(Splash.bmp);
+    Splash.filedata = Splash.picture = NULL;
+    Splash.jpeg = NULL;
+    Splash.bmp = NULL;
+}
+
+// Background thread decoding the image into the off-screen buffer.
+static void
+bootsplash_decode(void *data)
+{
+    int ret;
+    if (Splash.type == 0) {
+        dprintf(5, "Decompressing bootsplash.jpg\n");
+        ret = jpeg_show(Splash.jpeg, Splash.picture, Splash.width
+                        , Splash.height, Splash.depth
+                        , Splash.bytes_per_scanline);
+        if (ret)
+            dprintf(1, "jpeg_show failed with return code %d...\n", ret);
+    } else {
+        dprintf(5, "Decompressing bootsplash.bmp\n");
+        ret = bmp_show(Splash.bmp, Splash.picture, Splash.width
+                       , Splash.height, Splash.depth
+                       , Splash.bytes_per_scanline);
+        if (ret)
+            dprintf(1, "bmp_show failed with return code %d...\n", ret);
+    }
+    Splash.state = ret ? SPLASH_FAILED : SPLASH_READY;
+}
+
+// Find the splash image, pick a video mode, and start decoding it.
 void
-enable_bootsplash(void)
+bootsplash_setup(void)
 {
-    if (!CONFIG_BOOTSPLASH)
+    if (!CONFIG_BOOTSPLASH || Splash.state != SPLASH_NONE)
+        return;
+    Splash.state = SPLASH_FAILED;
+    if (!romfile_loadint("etc/show-boot-menu", 1))
         return;
     /* splash picture can be bmp or jpeg file */
     dprintf(3, "Checking for bootsplash\n");
-    u8 type = 0; /* 0 means jpg, 1 means bmp, default is 0=jpg */
     int filesize;
-    u8 *filedata = romfile_loadfile("bootsplash.jpg", &filesize);
-    if (!filedata) {
-        filedata = romfile_loadfile("bootsplash.bmp", &filesize);
-        if (!filedata)
+    Splash.type = 0;
+    Splash.filedata = romfile_loadfile("bootsplash.jpg", &filesize);
+    if (!Splash.filedata) {
+        Splash.filedata = romfile_loadfile("bootsplash.bmp", &filesize);
+        if (!Splash.filedata)
             return;
-        type = 1;
+        Splash.type = 1;
     }
-    dprintf(3, "start showing bootsplash\n");
+    dprintf(3, "start decoding bootsplash\n");
 
-    u8 *picture = NULL; /* data buff used to be flushed to the video buf */
-    struct jpeg_decdata *jpeg = NULL;
-    struct bmp_decdata *bmp = NULL;
     struct vbe_info *vesa_info = malloc_tmplow(sizeof(*vesa_info));
     struct vbe_mode_info *mode_info = malloc_tmplow(sizeof(*mode_info));
     if (!vesa_info || !mode_info) {
         warn_noalloc();
-        goto done;
+        goto fail;
     }
 
     /* Check whether we have a VESA 2.0 compliant BIOS */
@@ -133,7 +241,7 @@ enable_bootsplash(void)
     call16_int10(&br);
     if (vesa_info->signature != VESA_SIGNATURE) {
         dprintf(1,"No VBE2 found.\n");
-        goto done;
+        goto fail;
     }
 
     /* Print some debugging information about our card. */
@@ -145,37 +253,38 @@ enable_bootsplash(void)
 
     int ret, width, height;
     int bpp_require = 0;
-    if (type == 0) {
-        jpeg = jpeg_alloc();
-        if (!jpeg) {
+    if (Splash.type == 0) {
+        Splash.jpeg = jpeg_alloc();
+        if (!Splash.jpeg) {
             warn_noalloc();
-            goto done;
+            goto fail;
         }
         /* Parse jpeg and get image size. */
         dprintf(5, "Decoding bootsplash.jpg\n");
-        ret = jpeg_decode(jpeg, filedata);
+        ret = jpeg_decode(Splash.jpeg, Splash.filedata);
         if (ret) {
             dprintf(1, "jpeg_decode failed with return code %d...\n", ret);
-            goto done;
+            goto fail;
         }
-        jpeg_get_size(jpeg, &width, &height);
+        jpeg_get_size(Splash.jpeg, &width, &height);
     } else {
-        bmp = bmp_alloc();
-        if (!bmp) {
+        Splash.bmp = bmp_alloc();
+        if (!Splash.bmp) {
             warn_noalloc();
-            goto done;
+            goto fail;
         }
         /* Parse bmp and get image size. */
         dprintf(5, "Decoding bootsplash.bmp\n");
-        ret = bmp_decode(bmp, filedata, filesize);
+        ret = bmp_decode(Splash.bmp, Splash.filedata, filesize);
         if (ret) {
             dprintf(1, "bmp_decode failed with return code %d...\n", ret);
-            goto done;
+            goto fail;
         }
-        bmp_get_info(bmp, &width, &height, &bpp_require);
+        bmp_get_info(Splash.bmp, &width, &height, &bpp_require);
     }
 
-    // jpeg would use 16 or 24 bpp video mode, BMP uses 16/24/32 bpp mode.
+    // jpeg would use 16 or 24 bpp video mode, BMP uses 16/24/32 bpp mode
+    // (a specific depth if its pixels can be copied without conversion).
 
     // Try to find a graphics mode with the corresponding dimensions.
     int videomode = find_videomode(vesa_info, mode_info, width, height,
@@ -183,66 +292,97 @@ enable_bootsplash(void)
     if (videomode < 0) {
         dprintf(1, "failed to find a videomode with %dx%d %dbpp (0=any).\n",
                     width, height, bpp_require);
-        goto done;
+        goto fail;
     }
-    void *framebuffer = (void *)mode_info->phys_base;
-    int depth = mode_info->bits_per_pixel;
+    Splash.videomode = videomode;
+    Splash.framebuffer = (void *)mode_info->phys_base;
+    Splash.width = width;
+    Splash.height = height;
+    Splash.depth = mode_info->bits_per_pixel;
+    Splash.bytes_per_scanline = mode_info->bytes_per_scanline;
     dprintf(3, "mode: %04x\n", videomode);
-    dprintf(3, "framebuffer: %p\n", framebuffer);
-    dprintf(3, "bytes per scanline: %d\n", mode_info->bytes_per_scanline);
-    dprintf(3, "bits per pixel: %d\n", depth);
-
-    // Allocate space for image and decompress it.
-    int imagesize = height * mode_info->bytes_per_scanline;
-    picture = malloc_tmphigh(imagesize);
-    if (!picture) {
-        warn_noalloc();
-        goto done;
+    dprintf(3, "framebuffer: %p\n", Splash.framebuffer);
+    dprintf(3, "bytes per scanline: %d\n", Splash.bytes_per_scanline);
+    dprintf(3, "bits per pixel: %d\n", Splash.depth);
+
+    if (bpp_require) {
+        // BMP already in the mode's pixel format - it is copied straight
+        // to the framebuffer when shown.
+        free(vesa_info);
+        free(mode_info);
+        Splash.state = SPLASH_READY;
+        return;
     }
 
-    if (type == 0) {
-        dprintf(5, "Decompressing bootsplash.jpg\n");
-        ret = jpeg_show(jpeg, picture, width, height, depth,
-                            mode_info->bytes_per_scanline);
-        if (ret) {
-            dprintf(1, "jpeg_show failed with return code %d...\n", ret);
-            goto done;
-        }
-    } else {
-        dprintf(5, "Decompressing bootsplash.bmp\n");
-        ret = bmp_show(bmp, picture, width, height, depth,
-                           mode_info->bytes_per_scanline);
-        if (ret) {
-            dprintf(1, "bmp_show failed with return code %d...\n", ret);
-            goto done;
-        }
+    // Allocate space for image and decompress it in the background.
+    Splash.picture = malloc_tmphigh(height * Splash.bytes_per_scanline);
+    if (!Splash.picture) {
+        warn_noalloc();
+        goto fail;
     }
+    free(vesa_info);
+    free(mode_info);
+
+    Splash.state = SPLASH_DECODING;
+    run_thread(bootsplash_decode, NULL);
+    return;
+
+fail:
+    free(vesa_info);
+    free(mode_info);
+    bootsplash_free();
+}
+
+void
+enable_bootsplash(void)
+{
+    if (!CONFIG_BOOTSPLASH)
+        return;
+    bootsplash_setup();
+    while (Splash.state == SPLASH_DECODING)
+        yield();
+    if (Splash.state != SPLASH_READY)
+        goto done;
 
     /* Switch to graphics mode */
     dprintf(5, "Switching to graphics mode\n");
+    struct bregs br;
     memset(&br, 0, sizeof(br));
     br.ax = 0x4f02;
-    br.bx = videomode | VBE_MODE_LINEAR_FRAME_BUFFER;
+    br.bx = Splash.videomode | VBE_MODE_LINEAR_FRAME_BUFFER;
     call16_int10(&br);
     if (br.ax != 0x4f) {
         dprintf(1, "set_mode failed.\n");
-        goto done;
+        goto textmode;
     }
 
     /* Show the picture */
     dprintf(5, "Showing bootsplash picture\n");
-    iomemcpy(framebuffer, picture, imagesize);
+    if (Splash.picture) {
+        iomemcpy(Splash.framebuffer, Splash.picture
+                 , Splash.height * Splash.bytes_per_scanline);
+    } else {
+        int ret = bmp_show(Splash.bmp, Splash.framebuffer, Splash.width
+                           , Splash.height, Splash.depth
+                           , Splash.bytes_per_scanline);
+        if (ret) {
+            dprintf(1, "bmp_show failed with return code %d...\n", ret);
+            goto textmode;
+        }
+    }
     dprintf(5, "Bootsplash copy complete\n");
     BootsplashActive = 1;
 
+    goto done;
+
+textmode:
+    // Go back to the text mode the console was left in.
+    memset(&br, 0, sizeof(br));
+    br.ax = 0x0003;
+    call16_int10(&br);
 done:
-    free(filedata);
-    free(picture);
-    free(vesa_info);
-    free(mode_info);
-    free(jpeg);
-    free(bmp);
-    return;
+    Splash.state = SPLASH_FAILED;
+    bootsplash_free();
 }
 
 void
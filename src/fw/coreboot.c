@@ -9,6 +9,7 @@
 #include "config.h" // CONFIG_*
 #include "e820map.h" // e820_add
 #include "hw/pcidevice.h" // pci_probe_devices
+#include "lz4.h" // lz4_frame_decode
 #include "lzmadecode.h" // LzmaDecode
 #include "malloc.h" // free
 #include "output.h" // dprintf
@@ -321,9 +322,11 @@ coreboot_platform_setup(void)
  * ulzma
  ****************************************************************/
 
-// Uncompress data in flash to an area of memory.
+// Uncompress data in flash to an area of memory using the given
+// probability table.
 static int
-ulzma(u8 *dst, u32 maxlen, const u8 *src, u32 srclen)
+ulzma_probs(u8 *dst, u32 maxlen, const u8 *src, u32 srclen
+            , CProb *probs, u32 probsize)
 {
     dprintf(3, "Uncompressing data %d@%p to %d@%p\n", srclen, src, maxlen, dst);
     CLzmaDecoderState state;
@@ -332,13 +335,12 @@ ulzma(u8 *dst, u32 maxlen, const u8 *src, u32 srclen)
         dprintf(1, "LzmaDecodeProperties error - %d\n", ret);
         return -1;
     }
-    u8 scratch[15980];
     int need = (LzmaGetNumProbs(&state.Properties) * sizeof(CProb));
-    if (need > sizeof(scratch)) {
-        dprintf(1, "LzmaDecode need %d have %d\n", need, (unsigned int)sizeof(scratch));
+    if (need > probsize) {
+        dprintf(1, "LzmaDecode need %d have %d\n", need, probsize);
         return -1;
     }
-    state.Probs = (CProb *)scratch;
+    state.Probs = probs;
 
     u32 dstlen = *(u32*)(src + LZMA_PROPERTIES_SIZE);
     if (dstlen > maxlen) {
@@ -355,6 +357,35 @@ ulzma(u8 *dst, u32 maxlen, const u8 *src, u32 srclen)
     return dstlen;
 }
 
+// Uncompress data using an on-stack probability table (safe at boot).
+static int
+ulzma(u8 *dst, u32 maxlen, const u8 *src, u32 srclen)
+{
+    u8 scratch[15980];
+    return ulzma_probs(dst, maxlen, src, srclen
+                       , (CProb *)scratch, sizeof(scratch));
+}
+
+// Uncompress data using a probability table sized for the stream's
+// lc/lp settings (and kept off the small thread stacks).
+static int
+ulzma_alloc(u8 *dst, u32 maxlen, const u8 *src, u32 srclen)
+{
+    CLzmaProperties props;
+    if (LzmaDecodeProperties(&props, src, LZMA_PROPERTIES_SIZE)
+        != LZMA_RESULT_OK)
+        return ulzma_probs(dst, maxlen, src, srclen, NULL, 0);
+    u32 need = LzmaGetNumProbs(&props) * sizeof(CProb);
+    CProb *probs = malloc_tmp(need);
+    if (!probs) {
+        warn_noalloc();
+        return -1;
+    }
+    int ret = ulzma_probs(dst, maxlen, src, srclen, probs, need);
+    free(probs);
+    return ret;
+}
+
 
 /****************************************************************
  * Coreboot flash format
@@ -379,11 +410,30 @@ struct cbfs_file {
     u64 magic;
     u32 len;
     u32 type;
-    u32 checksum;
+    u32 attributes_offset;
     u32 offset;
     char filename[0];
 } PACKED;
 
+#define CBFS_COMPRESS_NONE  0
+#define CBFS_COMPRESS_LZMA  1
+#define CBFS_COMPRESS_LZ4   2
+
+struct cbfs_file_attribute {
+    u32 tag;
+    u32 len;
+} PACKED;
+
+#define CBFS_FILE_ATTR_TAG_UNUSED       0
+#define CBFS_FILE_ATTR_TAG_UNUSED2      0xffffffff
+#define CBFS_FILE_ATTR_TAG_COMPRESSION  0x42435a4c
+
+struct cbfs_file_attr_compression {
+    struct cbfs_file_attribute hdr;
+    u32 compression;
+    u32 decompressed_size;
+} PACKED;
+
 struct cbfs_romfile_s {
     struct romfile_s file;
     struct cbfs_file *fhdr;
@@ -391,6 +441,40 @@ struct cbfs_romfile_s {
     u32 rawsize, flags;
 };
 
+// Find the attribute with the given tag in a file's attribute area.
+static struct cbfs_file_attribute *
+cbfs_find_attr(struct cbfs_file *fhdr, u32 tag, u32 minlen)
+{
+    u32 pos = be32_to_cpu(fhdr->attributes_offset);
+    u32 end = be32_to_cpu(fhdr->offset);
+    if (!pos)
+        return NULL;
+    while (pos + sizeof(struct cbfs_file_attribute) <= end) {
+        struct cbfs_file_attribute *attr = (void*)fhdr + pos;
+        u32 atag = be32_to_cpu(attr->tag), alen = be32_to_cpu(attr->len);
+        if (atag == CBFS_FILE_ATTR_TAG_UNUSED
+            || atag == CBFS_FILE_ATTR_TAG_UNUSED2
+            || alen < sizeof(*attr) || alen > end - pos)
+            break;
+        if (atag == tag)
+            return alen >= minlen ? attr : NULL;
+        pos += alen;
+    }
+    return NULL;
+}
+
+// Uncompress data of the given CBFS compression type.
+static int
+cbfs_decompress(u32 compression, void *dst, u32 maxlen
+                , const void *src, u32 srclen)
+{
+    if (CONFIG_LZ4 && compression == CBFS_COMPRESS_LZ4)
+        return lz4_frame_decode(dst, maxlen, src, srclen);
+    return ulzma_alloc(dst, maxlen, src, srclen);
+}
+
+#define CBFS_COPY_CHUNK (64*1024)
+
 // Copy a file to memory (uncompressing if necessary)
 static int
 cbfs_copyfile(struct romfile_s *file, void *dst, u32 maxlen)
@@ -403,26 +487,37 @@ cbfs_copyfile(struct romfile_s *file, void *dst, u32 maxlen)
     u32 size = cfile->rawsize;
     void *src = cfile->data;
     if (cfile->flags) {
-        // Compressed - copy to temp ram and uncompress it.
-        void *temp = malloc_tmphigh(size);
-        if (!temp) {
-            warn_noalloc();
-            return -1;
-        }
-        iomemcpy(temp, src, size);
-        int ret = ulzma(dst, maxlen, temp, size);
+        // Compressed - copy to temp ram (the decoder reads the input a
+        // byte at a time, which is slow on uncached flash) and uncompress.
+        void *temp = NULL;
+        if (!runningOnQEMU())
+            temp = malloc_tmphigh(size);
+        if (temp)
+            iomemcpy(temp, src, size);
+        else
+            // Flash is ram backed (or no room for a copy) - decode in place.
+            dprintf(3, "Decoding directly from flash\n");
+        int ret = cbfs_decompress(cfile->flags, dst, maxlen
+                                  , temp ?: src, size);
         yield();
         free(temp);
         return ret;
     }
 
-    // Not compressed.
+    // Not compressed - copy in chunks so other threads can run.
     dprintf(3, "Copying data %d@%p to %d@%p\n", size, src, maxlen, dst);
     if (size > maxlen) {
         warn_noalloc();
         return -1;
     }
-    iomemcpy(dst, src, size);
+    u32 pos;
+    for (pos = 0; pos < size; pos += CBFS_COPY_CHUNK) {
+        u32 len = size - pos;
+        if (len > CBFS_COPY_CHUNK)
+            len = CBFS_COPY_CHUNK;
+        iomemcpy(dst + pos, src + pos, len);
+        yield();
+    }
     return size;
 }
 
@@ -507,17 +602,40 @@ coreboot_cbfs_init(void)
         cfile->fhdr = fhdr;
         cfile->file.copy = cbfs_copyfile;
         cfile->data = (void*)fhdr + be32_to_cpu(fhdr->offset);
+        struct cbfs_file_attr_compression *cattr = (void*)cbfs_find_attr(
+            fhdr, CBFS_FILE_ATTR_TAG_COMPRESSION, sizeof(*cattr));
         int len = strlen(cfile->file.name);
-        if (len > 5 && strcmp(&cfile->file.name[len-5], ".lzma") == 0) {
+        if (cattr) {
+            u32 compression = be32_to_cpu(cattr->compression);
+            if ((CONFIG_LZMA && compression == CBFS_COMPRESS_LZMA)
+                || (CONFIG_LZ4 && compression == CBFS_COMPRESS_LZ4)) {
+                cfile->flags = compression;
+                cfile->file.size = be32_to_cpu(cattr->decompressed_size);
+            } else if (compression != CBFS_COMPRESS_NONE) {
+                dprintf(1, "No support for compression type %x (%s)\n"
+                        , compression, cfile->file.name);
+                free(cfile);
+                goto next;
+            }
+        } else if (CONFIG_LZMA && len > 5
+            && strcmp(&cfile->file.name[len-5], ".lzma") == 0) {
             // Using compression.
-            cfile->flags = 1;
+            cfile->flags = CBFS_COMPRESS_LZMA;
             cfile->file.name[len-5] = '\0';
             cfile->file.size = *(u32*)(cfile->data + LZMA_PROPERTIES_SIZE);
+        } else if (CONFIG_LZ4 && len > 4
+                   && strcmp(&cfile->file.name[len-4], ".lz4") == 0) {
+            int size = lz4_frame_size(cfile->data, cfile->rawsize);
+            if (size >= 0) {
+                cfile->flags = CBFS_COMPRESS_LZ4;
+                cfile->file.name[len-4] = '\0';
+                cfile->file.size = size;
+            }
         }
         romfile_add(&cfile->file);
-
-        fhdr = (void*)ALIGN((u32)cfile->data + cfile->rawsize
-                            , be32_to_cpu(hdr->align));
+next:
+        fhdr = (void*)ALIGN((u32)fhdr + be32_to_cpu(fhdr->offset)
+                            + be32_to_cpu(fhdr->len), be32_to_cpu(hdr->align));
     }
 
     process_links_file();
@@ -535,9 +653,6 @@ struct cbfs_payload_segment {
 #define PAYLOAD_SEGMENT_BSS    0x20535342
 #define PAYLOAD_SEGMENT_ENTRY  0x52544E45
 
-#define CBFS_COMPRESS_NONE  0
-#define CBFS_COMPRESS_LZMA  1
-
 struct cbfs_payload {
     struct cbfs_payload_segment segments[1];
 };
@@ -579,6 +694,12 @@ cbfs_run_payload(struct cbfs_file *fhdr)
                 if (ret < 0)
                     return;
                 src_len = ret;
+            } else if (CONFIG_LZ4
+                       && seg->compression == cpu_to_be32(CBFS_COMPRESS_LZ4)) {
+                int ret = lz4_frame_decode(dest, dest_len, src, src_len);
+                if (ret < 0)
+                    return;
+                src_len = ret;
             } else {
                 dprintf(1, "No support for compression type %x\n"
                         , seg->compression);
@@ -0,0 +1,174 @@
+// LZ4 frame decompression (as used by coreboot's cbfstool).
+//
+// This file may be distributed under the terms of the GNU LGPLv3 license.
+
+#include "byteorder.h" // le32_to_cpu
+#include "lz4.h" // lz4_frame_decode
+#include "output.h" // dprintf
+#include "stacks.h" // yield
+#include "string.h" // memcpy
+
+#define LZ4F_MAGIC 0x184D2204
+
+#define LZ4F_FLG_VERSION_MASK    0xc0
+#define LZ4F_FLG_VERSION         0x40
+#define LZ4F_FLG_BLOCK_CHECKSUM  0x10
+#define LZ4F_FLG_CONTENT_SIZE    0x08
+#define LZ4F_FLG_DICT_ID         0x01
+
+#define LZ4F_BLOCK_UNCOMPRESSED  0x80000000
+
+#define LZ4_MIN_MATCH 4
+
+// Read an LZ4 length extension (a run of bytes terminated by a non-255).
+static int
+lz4_extlen(const u8 **psrc, const u8 *send, u32 *plen)
+{
+    const u8 *src = *psrc;
+    u8 b;
+    do {
+        if (src >= send)
+            return -1;
+        b = *src++;
+        *plen += b;
+    } while (b == 255);
+    *psrc = src;
+    return 0;
+}
+
+// Decode a single LZ4 block to dst+pos.  Matches may reach back into
+// earlier blocks of the same frame.  If 'dst' is NULL the block is
+// only parsed to find its decompressed length.  Returns the new
+// position or -1 on error.
+static int
+lz4_block_decode(u8 *dst, u32 pos, u32 maxlen, const u8 *src, u32 srclen)
+{
+    const u8 *send = src + srclen;
+    for (;;) {
+        if (src >= send)
+            return -1;
+        u8 token = *src++;
+
+        // Literals
+        u32 len = token >> 4;
+        if (len == 15 && lz4_extlen(&src, send, &len))
+            return -1;
+        if (len > send - src || len > maxlen - pos)
+            return -1;
+        if (dst)
+            memcpy(dst + pos, src, len);
+        src += len;
+        pos += len;
+        if (src == send)
+            // The last sequence in a block only contains literals.
+            return pos;
+
+        // Match
+        if (send - src < 2)
+            return -1;
+        u32 offset = src[0] | (src[1] << 8);
+        src += 2;
+        if (!offset || offset > pos)
+            return -1;
+        len = token & 0x0f;
+        if (len == 15 && lz4_extlen(&src, send, &len))
+            return -1;
+        len += LZ4_MIN_MATCH;
+        if (len > maxlen - pos)
+            return -1;
+        if (dst) {
+            u8 *d = dst + pos, *s = d - offset, *end = d + len;
+            if (offset >= 4)
+                // Source trails destination by at least a word, so
+                // whole words can be copied even when overlapping.
+                for (; d + 4 <= end; d += 4, s += 4)
+                    *(u32*)d = *(u32*)s;
+            while (d < end)
+                *d++ = *s++;
+        }
+        pos += len;
+    }
+}
+
+// Walk an LZ4 frame, decoding each block to 'dst' (or just sizing
+// them if 'dst' is NULL).  Returns the decompressed length or -1.
+static int
+lz4_frame_walk(u8 *dst, u32 maxlen, const u8 *src, u32 srclen)
+{
+    const u8 *send = src + srclen;
+    if (srclen < 7 || le32_to_cpu(*(u32*)src) != LZ4F_MAGIC) {
+        dprintf(1, "lz4: invalid frame magic\n");
+        return -1;
+    }
+    u8 flg = src[4];
+    if ((flg & LZ4F_FLG_VERSION_MASK) != LZ4F_FLG_VERSION) {
+        dprintf(1, "lz4: unsupported frame version (flg=%x)\n", flg);
+        return -1;
+    }
+    u32 hdrlen = 7;
+    if (flg & LZ4F_FLG_CONTENT_SIZE)
+        hdrlen += 8;
+    if (flg & LZ4F_FLG_DICT_ID)
+        hdrlen += 4;
+    if (hdrlen > srclen)
+        return -1;
+    src += hdrlen;
+
+    u32 pos = 0;
+    for (;;) {
+        if (send - src < 4)
+            return -1;
+        u32 blocksize = le32_to_cpu(*(u32*)src);
+        src += 4;
+        if (!blocksize)
+            // End mark (any content checksum that follows is ignored)
+            return pos;
+        u32 size = blocksize & ~LZ4F_BLOCK_UNCOMPRESSED;
+        if (size > send - src)
+            return -1;
+        if (blocksize & LZ4F_BLOCK_UNCOMPRESSED) {
+            if (size > maxlen - pos)
+                return -1;
+            if (dst)
+                memcpy(dst + pos, src, size);
+            pos += size;
+        } else {
+            int ret = lz4_block_decode(dst, pos, maxlen, src, size);
+            if (ret < 0) {
+                dprintf(1, "lz4: corrupt block at offset %d\n", pos);
+                return -1;
+            }
+            pos = ret;
+        }
+        if (dst)
+            // Let other threads run between blocks
+            yield();
+        src += size;
+        if (flg & LZ4F_FLG_BLOCK_CHECKSUM)
+            src += 4;
+    }
+}
+
+// Determine the decompressed size of an LZ4 frame.
+int
+lz4_frame_size(const void *src, u32 srclen)
+{
+    const u8 *p = src;
+    if (srclen >= 14 && le32_to_cpu(*(u32*)p) == LZ4F_MAGIC
+        && (p[4] & LZ4F_FLG_CONTENT_SIZE)) {
+        u64 size = le64_to_cpu(*(u64*)&p[6]);
+        if (size <= 0x7fffffff)
+            return size;
+    }
+    // cbfstool doesn't record the content size - parse the blocks.
+    return lz4_frame_walk(NULL, 0x7fffffff, src, srclen);
+}
+
+// Decompress an LZ4 frame.  Returns the decompressed length or -1.
+int
+lz4_frame_decode(void *dst, u32 maxlen, const void *src, u32 srclen)
+{
+    dprintf(3, "Uncompressing lz4 data %d@%p to %d@%p\n"
+            , srclen, src, maxlen, dst);
+    return lz4_frame_walk(dst, maxlen, src, srclen);
+}
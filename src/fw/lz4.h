@@ -0,0 +1,10 @@
+#ifndef __LZ4_H
+#define __LZ4_H
+
+#include "types.h" // u32
+
+// lz4.c
+int lz4_frame_size(const void *src, u32 srclen);
+int lz4_frame_decode(void *dst, u32 maxlen, const void *src, u32 srclen);
+
+#endif // lz4.h
@@ -20,6 +20,7 @@
 */
 
 #include "lzmadecode.h"
+#include "stacks.h" // yield
 
 #define kNumTopBits 24
 #define kTopValue ((UInt32)1 << kNumTopBits)
@@ -58,6 +59,9 @@
 
 
 #define kNumPosBitsMax 4
+
+/* Let other threads run after every this many bytes of output */
+#define kYieldInterval 0x10000
 #define kNumPosStatesMax (1 << kNumPosBitsMax)
 
 #define kLenNumLowBits 3
@@ -151,6 +155,7 @@ int LzmaDecode(CLzmaDecoderState *vs,
   const Byte *BufferLim;
   UInt32 Range;
   UInt32 Code;
+  SizeT nextYield = kYieldInterval;
 
   *inSizeProcessed = 0;
   *outSizeProcessed = 0;
@@ -174,6 +179,12 @@ int LzmaDecode(CLzmaDecoderState *vs,
         )
         & posStateMask);
 
+    if (nowPos >= nextYield)
+    {
+      yield();
+      nextYield = nowPos + kYieldInterval;
+    }
+
     prob = p + IsMatch + (state << kNumPosBitsMax) + posState;
     IfBit0(prob)
     {
@@ -339,14 +350,13 @@ int LzmaDecode(CLzmaDecoderState *vs,
             numDirectBits -= kNumAlignBits;
             do
             {
+              UInt32 t;
               RC_NORMALIZE
               Range >>= 1;
-              rep0 <<= 1;
-              if (Code >= Range)
-              {
-                Code -= Range;
-                rep0 |= 1;
-              }
+              Code -= Range;
+              t = 0 - ((UInt32)Code >> 31); /* all ones if Code < Range */
+              Code += Range & t;
+              rep0 = (rep0 << 1) + (t + 1);
             }
             while (--numDirectBits != 0);
             prob = p + Align;
@@ -380,13 +390,23 @@ int LzmaDecode(CLzmaDecoderState *vs,
         return LZMA_RESULT_DATA_ERROR;
 
 
-      do
+      if ((SizeT)len > outSize - nowPos)
+        len = (int)(outSize - nowPos);
       {
-        previousByte = outStream[nowPos - rep0];
-        len--;
-        outStream[nowPos++] = previousByte;
+        Byte *dest = outStream + nowPos;
+        const Byte *src = dest - rep0;
+        nowPos += len;
+        if (rep0 >= 4)
+        {
+          /* Source trails destination by at least a word, so whole
+             words can be copied even when the ranges overlap. */
+          for (; len >= 4; len -= 4, dest += 4, src += 4)
+            *(UInt32 *)dest = *(const UInt32 *)src;
+        }
+        for (; len != 0; len--)
+          *dest++ = *src++;
+        previousByte = dest[-1];
       }
-      while(len != 0 && nowPos < outSize);
     }
   }
   RC_NORMALIZE;
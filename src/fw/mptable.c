@@ -74,7 +74,7 @@ mptable_setup(void)
 
     // PCI bus
     struct mpt_bus *buses = (void*)cpu, *bus = buses;
-    if (!hlist_empty(&PCIDevices)) {
+    if (PCIDeviceCount) {
         memset(bus, 0, sizeof(*bus));
         bus->type = MPT_TYPE_BUS;
         bus->busid = 0;
@@ -7,6 +7,7 @@
 #include "config.h" // CONFIG_*
 #include "output.h" // dprintf
 #include "paravirt.h" // RamSize
+#include "romfile.h" // romfile_loadint
 #include "util.h" // mtrr_setup
 #include "x86.h" // cpuid
 
@@ -33,12 +34,28 @@
 #define MTRR_MEMTYPE_WP 5
 #define MTRR_MEMTYPE_WB 6
 
+#define MTRRcap_WC     (1<<10)
+#define MTRRdefType_E  (1<<11)
+#define MTRRphysMask_V (1<<11)
+
+static int
+mtrr_phys_bits(void)
+{
+    u32 eax, ebx, ecx, edx;
+    cpuid(0x80000000u, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000008)
+        return 36;
+    /* Get physical bits from leaf 0x80000008 (if available) */
+    cpuid(0x80000008u, &eax, &ebx, &ecx, &edx);
+    return eax & 0xff;
+}
+
 void mtrr_setup(void)
 {
     if (!CONFIG_MTRR_INIT)
         return;
 
-    u32 eax, ebx, ecx, edx, cpuid_features;
+    u32 eax, ebx, ecx, cpuid_features;
     cpuid(1, &eax, &ebx, &ecx, &cpuid_features);
     if (!(cpuid_features & CPUID_MTRR))
         return;
@@ -83,14 +100,7 @@ void mtrr_setup(void)
     }
 
     // Set variable MTRRs
-    int phys_bits = 36;
-    cpuid(0x80000000u, &eax, &ebx, &ecx, &edx);
-    if (eax >= 0x80000008) {
-        /* Get physical bits from leaf 0x80000008 (if available) */
-        cpuid(0x80000008u, &eax, &ebx, &ecx, &edx);
-        phys_bits = eax & 0xff;
-    }
-    u64 phys_mask = ((1ull << phys_bits) - 1);
+    u64 phys_mask = ((1ull << mtrr_phys_bits()) - 1);
     for (i=0; i<vcnt; i++) {
         wrmsr_smp(MTRRphysBase_MSR(i), 0);
         wrmsr_smp(MTRRphysMask_MSR(i), 0);
@@ -103,3 +113,88 @@ void mtrr_setup(void)
     // Enable fixed and variable MTRRs; set default type.
     wrmsr_smp(MSR_MTRRdefType, 0xc00 | MTRR_MEMTYPE_WB);
 }
+
+
+/****************************************************************
+ * Write-combining framebuffer
+ ****************************************************************/
+
+static int FramebufferMTRR = -1, FramebufferMTRRKeep;
+
+// Map (a naturally aligned part of) the given framebuffer as
+// write-combining using a free variable MTRR.  Only the boot cpu is
+// updated - the other cpus are halted and the OS resyncs them.
+void
+mtrr_wc_setup(u32 addr, u32 size)
+{
+    if (!CONFIG_MTRR_WC_FRAMEBUFFER || FramebufferMTRR >= 0 || !addr || !size)
+        return;
+    int mode = romfile_loadint("etc/framebuffer-wc", 1);
+    if (!mode)
+        return;
+
+    u32 eax, ebx, ecx, cpuid_features;
+    cpuid(1, &eax, &ebx, &ecx, &cpuid_features);
+    if (!(cpuid_features & CPUID_MTRR) || !(cpuid_features & CPUID_MSR))
+        return;
+    u32 mtrr_cap = rdmsr(MSR_MTRRcap);
+    u64 deftype = rdmsr(MSR_MTRRdefType);
+    if (!(mtrr_cap & MTRRcap_WC) || !(deftype & MTRRdefType_E))
+        return;
+
+    // A variable MTRR must be a power of two in size and aligned to it.
+    size = 1 << __fls(size);
+    while (addr & (size - 1))
+        size >>= 1;
+    if (size < 4096)
+        return;
+
+    // Find a free MTRR.  Overlapping ranges are left alone - an
+    // existing UC range would take precedence over WC anyway.
+    u64 phys_mask = ((1ull << mtrr_phys_bits()) - 1);
+    int vcnt = mtrr_cap & 0xff, free = -1, i;
+    for (i=0; i<vcnt; i++) {
+        u64 mask = rdmsr(MTRRphysMask_MSR(i));
+        if (!(mask & MTRRphysMask_V)) {
+            if (free < 0)
+                free = i;
+            continue;
+        }
+        u64 base = rdmsr(MTRRphysBase_MSR(i)) & mask & phys_mask & ~0xfffull;
+        u64 len = ((~mask & phys_mask) | 0xfff) + 1;
+        if (base < (u64)addr + size && base + len > addr) {
+            dprintf(1, "Framebuffer %x already covered by mtrr %d\n", addr, i);
+            return;
+        }
+    }
+    if (free < 0) {
+        dprintf(1, "No free mtrr for framebuffer %x\n", addr);
+        return;
+    }
+
+    dprintf(1, "Mapping framebuffer %x-%x write-combining (mtrr %d)\n"
+            , addr, addr + size - 1, free);
+    wrmsr(MSR_MTRRdefType, 0);
+    wbinvd();
+    wrmsr(MTRRphysBase_MSR(free), addr | MTRR_MEMTYPE_WC);
+    wrmsr(MTRRphysMask_MSR(free), (-(u64)size & phys_mask) | MTRRphysMask_V);
+    wrmsr(MSR_MTRRdefType, deftype);
+    FramebufferMTRR = free;
+    FramebufferMTRRKeep = mode > 1;
+}
+
+// Remove the framebuffer mapping before handing control to the OS.
+void
+mtrr_prepboot(void)
+{
+    if (!CONFIG_MTRR_WC_FRAMEBUFFER || FramebufferMTRR < 0
+        || FramebufferMTRRKeep)
+        return;
+    u64 deftype = rdmsr(MSR_MTRRdefType);
+    wrmsr(MSR_MTRRdefType, 0);
+    wbinvd();
+    wrmsr(MTRRphysMask_MSR(FramebufferMTRR), 0);
+    wrmsr(MTRRphysBase_MSR(FramebufferMTRR), 0);
+    wrmsr(MSR_MTRRdefType, deftype);
+    FramebufferMTRR = -1;
+}
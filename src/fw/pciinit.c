@@ -28,6 +28,7 @@
 #define PCI_DEVICE_MEM_MIN    (1<<12)  // 4k == page size
 #define PCI_BRIDGE_MEM_MIN    (1<<21)  // 2M == hugepage size
 #define PCI_BRIDGE_IO_MIN      0x1000  // mandated by pci bridge spec
+#define PCI_BRIDGE_MEM_GRAN   (1<<20)  // granularity of bridge mem windows
 
 #define PCI_ROM_SLOT 6
 #define PCI_NUM_REGIONS 7
@@ -52,6 +53,9 @@ u64 pcimem64_start = BUILD_PCIMEM64_START;
 u64 pcimem64_end   = BUILD_PCIMEM64_END;
 u64 pci_io_low_end = 0xa000;
 
+// Pack bars tightly into bridge windows (see etc/pci-resource-pack)
+static int PCIResourcePack;
+
 struct pci_region_entry {
     struct pci_device *dev;
     int bar;
@@ -488,9 +492,11 @@ static void mch_mem_addr_setup(struct pci_device *dev, void *arg)
     u64 addr = Q35_HOST_BRIDGE_PCIEXBAR_ADDR;
     u32 size = Q35_HOST_BRIDGE_PCIEXBAR_SIZE;
 
-    /* setup mmconfig */
-    MCHMmcfgBDF = dev->bdf;
-    mch_mmconfig_setup(dev->bdf);
+    /* setup mmconfig (if not already done by pci_bios_init_mmconfig) */
+    if (MCHMmcfgBDF != dev->bdf) {
+        MCHMmcfgBDF = dev->bdf;
+        mch_mmconfig_setup(dev->bdf);
+    }
     e820_add(addr, size, E820_RESERVED);
 
     /* setup pci i/o window (above mmconfig) */
@@ -513,6 +519,17 @@ static const struct pci_device_id pci_platform_tbl[] = {
     PCI_DEVICE_END
 };
 
+// Enable q35 mmconfig early so bus setup and probing can use it.
+static void pci_bios_init_mmconfig(void)
+{
+    u16 bdf = pci_to_bdf(0, 0, 0);
+    u32 vendev = pci_config_readl(bdf, PCI_VENDOR_ID);
+    if (vendev != (PCI_DEVICE_ID_INTEL_Q35_MCH << 16 | PCI_VENDOR_ID_INTEL))
+        return;
+    MCHMmcfgBDF = bdf;
+    mch_mmconfig_setup(bdf);
+}
+
 static void pci_bios_init_platform(void)
 {
     struct pci_device *pci;
@@ -557,6 +574,250 @@ static u8 pci_find_resource_reserve_capability(u16 bdf)
     return cap;
 }
 
+/****************************************************************
+ * Hotplug resource reservation policy
+ ****************************************************************/
+
+// Reservation sizes for one set of bridges (-1 means "not set").
+struct pci_hotplug_reserve {
+    int bdf;
+    u64 size[PCI_REGION_TYPE_COUNT];
+};
+
+#define PCI_HOTPLUG_MAX_SLOTS 64
+
+static struct {
+    int pcie_noio;
+    int poolcount;
+    struct pci_hotplug_reserve def, pool;
+    struct pci_hotplug_reserve *slots;
+    int slotcount;
+} HotplugPolicy;
+
+static const char *hotplug_policy_keys[] = {
+    [ PCI_REGION_TYPE_IO ]      = "io=",
+    [ PCI_REGION_TYPE_MEM ]     = "mem=",
+    [ PCI_REGION_TYPE_PREFMEM ] = "pref=",
+};
+
+static void
+pci_hotplug_reserve_init(struct pci_hotplug_reserve *res, int bdf)
+{
+    res->bdf = bdf;
+    int type;
+    for (type = 0; type < PCI_REGION_TYPE_COUNT; type++)
+        res->size[type] = (u64)-1;
+}
+
+// Parse a hex number (stopping at the first non-hex character).
+static char *
+parse_hex(char *cur, u32 *n)
+{
+    u32 m = 0;
+    for (;; cur++) {
+        char c = *cur;
+        if (c >= '0' && c <= '9')
+            m = (m << 4) | (c - '0');
+        else if (c >= 'a' && c <= 'f')
+            m = (m << 4) | (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            m = (m << 4) | (c - 'A' + 10);
+        else
+            break;
+    }
+    *n = m;
+    return cur;
+}
+
+// Parse a size such as "4096", "0x1000", "64K", "2M" or "1G".
+static char *
+parse_size(char *cur, u64 *size)
+{
+    u64 m = 0;
+    if (cur[0] == '0' && (cur[1] == 'x' || cur[1] == 'X')) {
+        u32 v;
+        cur = parse_hex(cur + 2, &v);
+        m = v;
+    } else {
+        while (*cur >= '0' && *cur <= '9')
+            m = 10 * m + (*cur++ - '0');
+    }
+    switch (*cur) {
+    case 'k': case 'K': m <<= 10; cur++; break;
+    case 'm': case 'M': m <<= 20; cur++; break;
+    case 'g': case 'G': m <<= 30; cur++; break;
+    }
+    *size = m;
+    return cur;
+}
+
+// Parse the "io=<size> mem=<size> pref=<size>" part of a policy line.
+static void
+pci_hotplug_parse_sizes(char *cur, struct pci_hotplug_reserve *res)
+{
+    for (;;) {
+        while (*cur == ' ' || *cur == '\t')
+            cur++;
+        if (!*cur)
+            return;
+        int type;
+        for (type = 0; type < PCI_REGION_TYPE_COUNT; type++) {
+            const char *key = hotplug_policy_keys[type];
+            int len = strlen(key);
+            if (memcmp(cur, key, len) == 0) {
+                cur = parse_size(cur + len, &res->size[type]);
+                break;
+            }
+        }
+        if (type >= PCI_REGION_TYPE_COUNT) {
+            dprintf(1, "PCI: hotplug policy: unknown option '%s'\n", cur);
+            return;
+        }
+    }
+}
+
+// Load the etc/pci-hotplug-policy file.  Each line is one of:
+//   pcie-no-io                       - no io window for pcie ports
+//   default io=<s> mem=<s> pref=<s>  - reserve for each hotplug bridge
+//   pool io=<s> mem=<s> pref=<s>     - split among all hotplug bridges
+//   <bus>:<dev>.<fn> io=<s> ...      - reserve for the given bridge
+static void
+pci_load_hotplug_policy(void)
+{
+    pci_hotplug_reserve_init(&HotplugPolicy.def, -1);
+    pci_hotplug_reserve_init(&HotplugPolicy.pool, -1);
+    char *f = romfile_loadfile("etc/pci-hotplug-policy", NULL);
+    if (!f)
+        return;
+    HotplugPolicy.slots = malloc_tmp(sizeof(*HotplugPolicy.slots)
+                                     * PCI_HOTPLUG_MAX_SLOTS);
+    if (!HotplugPolicy.slots) {
+        warn_noalloc();
+        free(f);
+        return;
+    }
+
+    char *line = f;
+    while (line && *line) {
+        char *next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        nullTrailingSpace(line);
+        while (*line == ' ' || *line == '\t')
+            line++;
+        int len = strlen(line);
+
+        if (!*line || *line == '#') {
+            // Comment or empty line
+        } else if (strcmp(line, "pcie-no-io") == 0) {
+            HotplugPolicy.pcie_noio = 1;
+        } else if (len > 8 && memcmp(line, "default ", 8) == 0) {
+            pci_hotplug_parse_sizes(line + 8, &HotplugPolicy.def);
+        } else if (len > 5 && memcmp(line, "pool ", 5) == 0) {
+            pci_hotplug_parse_sizes(line + 5, &HotplugPolicy.pool);
+        } else if (HotplugPolicy.slotcount < PCI_HOTPLUG_MAX_SLOTS) {
+            // Slot lines must use the full BUS:DEV.FN form
+            u32 bus, dev = 0, fn = 0;
+            char *cur = parse_hex(line, &bus);
+            int valid = *cur == ':';
+            if (valid) {
+                cur = parse_hex(cur + 1, &dev);
+                valid = *cur == '.';
+            }
+            if (valid) {
+                cur = parse_hex(cur + 1, &fn);
+                valid = *cur == ' ';
+            }
+            if (!valid || bus > 0xff || dev > 0x1f || fn > 7) {
+                dprintf(1, "PCI: hotplug policy: bad line '%s'\n", line);
+            } else {
+                struct pci_hotplug_reserve *res =
+                    &HotplugPolicy.slots[HotplugPolicy.slotcount++];
+                pci_hotplug_reserve_init(res, pci_to_bdf(bus, dev, fn));
+                pci_hotplug_parse_sizes(cur, res);
+            }
+        }
+        line = next;
+    }
+    free(f);
+    dprintf(1, "PCI: hotplug policy loaded (%d slots)\n"
+            , HotplugPolicy.slotcount);
+}
+
+static struct pci_hotplug_reserve *
+pci_hotplug_find_slot(u16 bdf)
+{
+    int i;
+    for (i = 0; i < HotplugPolicy.slotcount; i++)
+        if (HotplugPolicy.slots[i].bdf == bdf)
+            return &HotplugPolicy.slots[i];
+    return NULL;
+}
+
+static int pci_bus_hotplug_support(struct pci_bus *bus, u8 pcie_cap);
+
+// Count the hotplug bridges that share the reservation pool.
+static void
+pci_hotplug_count_pool(struct pci_bus *busses)
+{
+    int type, pool = 0;
+    for (type = 0; type < PCI_REGION_TYPE_COUNT; type++)
+        if (HotplugPolicy.pool.size[type] != (u64)-1)
+            pool = 1;
+    if (!pool)
+        return;
+    int secondary_bus;
+    for (secondary_bus=MaxPCIBus; secondary_bus>0; secondary_bus--) {
+        struct pci_bus *s = &busses[secondary_bus];
+        if (!s->bus_dev || pci_hotplug_find_slot(s->bus_dev->bdf))
+            continue;
+        u8 pcie_cap = pci_find_capability(s->bus_dev->bdf, PCI_CAP_ID_EXP, 0);
+        if (pci_bus_hotplug_support(s, pcie_cap))
+            HotplugPolicy.poolcount++;
+    }
+}
+
+// Determine the reservation for a bridge window from the hotplug
+// policy.  Returns 1 (and sets 'size') if the policy applies.
+static int
+pci_hotplug_policy_size(struct pci_bus *s, int type, u8 pcie_cap
+                        , int hotplug_support, u64 *size)
+{
+    if (type == PCI_REGION_TYPE_IO && pcie_cap && HotplugPolicy.pcie_noio) {
+        *size = 0;
+        return 1;
+    }
+    struct pci_hotplug_reserve *slot = pci_hotplug_find_slot(s->bus_dev->bdf);
+    if (slot) {
+        if (slot->size[type] == (u64)-1)
+            return 0;
+        *size = slot->size[type];
+        return 1;
+    }
+    if (!hotplug_support)
+        return 0;
+    if (HotplugPolicy.pool.size[type] != (u64)-1 && HotplugPolicy.poolcount) {
+        // Split the pool (in units of 1MiB for memory windows to
+        // avoid a 64bit division).
+        u64 align = PCI_BRIDGE_IO_MIN;
+        int shift = 0;
+        if (type != PCI_REGION_TYPE_IO) {
+            align = PCI_BRIDGE_MEM_MIN;
+            shift = 20;
+        }
+        u32 units = HotplugPolicy.pool.size[type] >> shift;
+        units /= HotplugPolicy.poolcount;
+        *size = ALIGN_DOWN((u64)units << shift, align);
+        return 1;
+    }
+    if (HotplugPolicy.def.size[type] != (u64)-1) {
+        *size = HotplugPolicy.def.size[type];
+        return 1;
+    }
+    return 0;
+}
+
+
 /****************************************************************
  * Bus initialization
  ****************************************************************/
@@ -749,15 +1010,52 @@ static u64 pci_region_sum(struct pci_region *r)
     return sum;
 }
 
+// Return the space needed to place all entries back to back (each at
+// its own alignment) starting from a base with the region's alignment.
+static u64 pci_region_packed_size(struct pci_region *r)
+{
+    u64 size = 0;
+    struct pci_region_entry *entry;
+    hlist_for_each_entry(entry, &r->list, node) {
+        size = ALIGN(size, entry->align) + entry->size;
+    }
+    return size;
+}
+
+// Return the space the region will occupy once its entries are mapped.
+static u64 pci_region_size(struct pci_region *r)
+{
+    if (PCIResourcePack)
+        return pci_region_packed_size(r);
+    return pci_region_sum(r);
+}
+
+static void pci_region_add_entry(struct pci_region *r,
+                                 struct pci_region_entry *entry)
+{
+    // Insert into list in sorted order.
+    struct hlist_node **pprev;
+    struct pci_region_entry *pos;
+    hlist_for_each_entry_pprev(pos, pprev, &r->list, node) {
+        if (pos->align < entry->align
+            || (pos->align == entry->align && pos->size < entry->size))
+            break;
+    }
+    hlist_add(&entry->node, pprev);
+}
+
+static int pci_region_entry_can_migrate(struct pci_region_entry *entry)
+{
+    return entry->is64 && entry->dev->class != PCI_CLASS_SERIAL_USB;
+}
+
 static void pci_region_migrate_64bit_entries(struct pci_region *from,
                                              struct pci_region *to)
 {
     struct hlist_node *n, **last = &to->list.first;
     struct pci_region_entry *entry;
     hlist_for_each_entry_safe(entry, n, &from->list, node) {
-        if (!entry->is64)
-            continue;
-        if (entry->dev->class == PCI_CLASS_SERIAL_USB)
+        if (!pci_region_entry_can_migrate(entry))
             continue;
         // Move from source list to destination list.
         hlist_del(&entry->node);
@@ -782,14 +1080,7 @@ pci_region_create_entry(struct pci_bus *bus, struct pci_device *dev,
     entry->align = align;
     entry->is64 = is64;
     entry->type = type;
-    // Insert into list in sorted order.
-    struct hlist_node **pprev;
-    struct pci_region_entry *pos;
-    hlist_for_each_entry_pprev(pos, pprev, &bus->r[type].list, node) {
-        if (pos->align < align || (pos->align == align && pos->size < size))
-            break;
-    }
-    hlist_add(&entry->node, pprev);
+    pci_region_add_entry(&bus->r[type], entry);
     return entry;
 }
 
@@ -887,6 +1178,8 @@ static int pci_bios_check_devices(struct pci_bus *busses)
         }
     }
 
+    pci_hotplug_count_pool(busses);
+
     // Propagate required bus resources to parent busses.
     int secondary_bus;
     for (secondary_bus=MaxPCIBus; secondary_bus>0; secondary_bus--) {
@@ -945,21 +1238,31 @@ static int pci_bios_check_devices(struct pci_bus *busses)
                     break;
                 }
             }
+            int policy = pci_hotplug_policy_size(s, type, pcie_cap
+                                                 , hotplug_support, &size);
             if (pci_region_align(&s->r[type]) > align)
                  align = pci_region_align(&s->r[type]);
-            u64 sum = pci_region_sum(&s->r[type]);
-            int resource_optional = pcie_cap && (type == PCI_REGION_TYPE_IO);
+            // In pack mode the window size only needs to be rounded up to
+            // the bridge window granularity (not to the window alignment).
+            u64 gran = align;
+            if (PCIResourcePack)
+                gran = (type == PCI_REGION_TYPE_IO) ?
+                    PCI_BRIDGE_IO_MIN : PCI_BRIDGE_MEM_GRAN;
+            u64 used = pci_region_sum(&s->r[type]);
+            u64 sum = pci_region_size(&s->r[type]);
+            int resource_optional = (pcie_cap && (type == PCI_REGION_TYPE_IO))
+                                    || policy;
             if (!sum && hotplug_support && !resource_optional)
                 sum = align; /* reserve min size for hot-plug */
             if (size > sum) {
-                dprintf(1, "PCI: QEMU resource reserve cap: "
-                        "size %08llx type %s\n",
-                        size, region_type_name[type]);
-                if (type != PCI_REGION_TYPE_IO) {
-                    size = ALIGN(size, align);
+                dprintf(1, "PCI: %s: size %08llx type %s\n"
+                        , policy ? "hotplug policy" : "QEMU resource reserve cap"
+                        , size, region_type_name[type]);
+                if (type != PCI_REGION_TYPE_IO || policy) {
+                    size = ALIGN(size, gran);
                 }
             } else {
-                size = ALIGN(sum, align);
+                size = ALIGN(sum, gran);
             }
             int is64 = pci_bios_bridge_region_is64(&s->r[type],
                                             s->bus_dev, type);
@@ -971,6 +1274,10 @@ static int pci_bios_check_devices(struct pci_bus *busses)
             dprintf(1, "PCI: secondary bus %d size %08llx type %s\n",
                       entry->dev->secondary_bus, size,
                       region_type_name[entry->type]);
+            if (used && size > used)
+                dprintf(1, "PCI: secondary bus %d type %s: used %08llx"
+                        " unused %08llx\n", entry->dev->secondary_bus
+                        , region_type_name[entry->type], used, size - used);
         }
     }
     return 0;
@@ -996,7 +1303,7 @@ static int pci_bios_init_root_regions_io(struct pci_bus *bus)
      *   c000 - ffff    free, traditionally used for pci io
      */
     struct pci_region *r_io = &bus->r[PCI_REGION_TYPE_IO];
-    u64 sum = pci_region_sum(r_io);
+    u64 sum = pci_region_size(r_io);
     if (sum < 0x4000) {
         /* traditional region is big enougth, use it */
         r_io->base = 0xc000;
@@ -1021,10 +1328,10 @@ static int pci_bios_init_root_regions_mem(struct pci_bus *bus)
         r_end = r_start;
         r_start = &bus->r[PCI_REGION_TYPE_PREFMEM];
     }
-    u64 sum = pci_region_sum(r_end);
+    u64 sum = pci_region_size(r_end);
     u64 align = pci_region_align(r_end);
     r_end->base = ALIGN_DOWN((pcimem_end - sum), align);
-    sum = pci_region_sum(r_start);
+    sum = pci_region_size(r_start);
     align = pci_region_align(r_start);
     r_start->base = ALIGN_DOWN((r_end->base - sum), align);
 
@@ -1077,6 +1384,8 @@ static void pci_region_map_entries(struct pci_bus *busses, struct pci_region *r)
     struct hlist_node *n;
     struct pci_region_entry *entry;
     hlist_for_each_entry_safe(entry, n, &r->list, node) {
+        if (PCIResourcePack)
+            r->base = ALIGN(r->base, entry->align);
         u64 addr = r->base;
         r->base += entry->size;
         if (entry->bar == -1)
@@ -1088,6 +1397,42 @@ static void pci_region_map_entries(struct pci_bus *busses, struct pci_region *r)
     }
 }
 
+// Return the largest entry of a region that may be mapped above 4G.
+static struct pci_region_entry *
+pci_region_find_64bit_entry(struct pci_region *r)
+{
+    struct pci_region_entry *entry;
+    hlist_for_each_entry(entry, &r->list, node) {
+        // The list is sorted - the first match is the largest.
+        if (pci_region_entry_can_migrate(entry))
+            return entry;
+    }
+    return NULL;
+}
+
+// Move the largest 64bit capable entries (prefetchable ones first) to
+// the 64bit window until the remaining entries fit below 4G.
+static void pci_region_migrate_64bit_pack(struct pci_bus *bus
+                                          , struct pci_region *r64_mem
+                                          , struct pci_region *r64_pref)
+{
+    while (pci_bios_init_root_regions_mem(bus)) {
+        struct pci_region *to = r64_pref;
+        struct pci_region_entry *entry = pci_region_find_64bit_entry(
+            &bus->r[PCI_REGION_TYPE_PREFMEM]);
+        if (!entry) {
+            to = r64_mem;
+            entry = pci_region_find_64bit_entry(&bus->r[PCI_REGION_TYPE_MEM]);
+            if (!entry)
+                return;
+        }
+        dprintf(1, "PCI: moving %pP size %08llx type %s above 4G\n"
+                , entry->dev, entry->size, region_type_name[entry->type]);
+        hlist_del(&entry->node);
+        pci_region_add_entry(to, entry);
+    }
+}
+
 static void pci_bios_map_devices(struct pci_bus *busses)
 {
     if (pci_bios_init_root_regions_io(busses))
@@ -1098,16 +1443,20 @@ static void pci_bios_map_devices(struct pci_bus *busses)
         struct pci_region r64_mem, r64_pref;
         r64_mem.list.first = NULL;
         r64_pref.list.first = NULL;
-        pci_region_migrate_64bit_entries(&busses[0].r[PCI_REGION_TYPE_MEM],
-                                         &r64_mem);
-        pci_region_migrate_64bit_entries(&busses[0].r[PCI_REGION_TYPE_PREFMEM],
-                                         &r64_pref);
+        if (PCIResourcePack) {
+            pci_region_migrate_64bit_pack(busses, &r64_mem, &r64_pref);
+        } else {
+            pci_region_migrate_64bit_entries(
+                &busses[0].r[PCI_REGION_TYPE_MEM], &r64_mem);
+            pci_region_migrate_64bit_entries(
+                &busses[0].r[PCI_REGION_TYPE_PREFMEM], &r64_pref);
+        }
 
         if (pci_bios_init_root_regions_mem(busses))
             panic("PCI: out of 32bit address space\n");
 
-        u64 sum_mem = pci_region_sum(&r64_mem);
-        u64 sum_pref = pci_region_sum(&r64_pref);
+        u64 sum_mem = pci_region_size(&r64_mem);
+        u64 sum_pref = pci_region_size(&r64_pref);
         u64 align_mem = pci_region_align(&r64_mem);
         u64 align_pref = pci_region_align(&r64_pref);
 
@@ -1156,6 +1505,7 @@ pci_setup(void)
     if (pci_probe_host() != 0) {
         return;
     }
+    pci_bios_init_mmconfig();
     pci_bios_init_bus();
 
     dprintf(1, "=== PCI device probing ===\n");
@@ -1164,6 +1514,9 @@ pci_setup(void)
     pcimem_start = RamSize;
     pci_bios_init_platform();
 
+    PCIResourcePack = romfile_loadint("etc/pci-resource-pack", 0);
+    pci_load_hotplug_policy();
+
     dprintf(1, "=== PCI new allocation pass #1 ===\n");
     struct pci_bus *busses = malloc_tmp(sizeof(*busses) * (MaxPCIBus + 1));
     if (!busses) {
@@ -1019,7 +1019,7 @@ static const struct pci_device_id pci_ata_tbl[] = {
 static void
 ata_scan(void)
 {
-    if (CONFIG_QEMU && hlist_empty(&PCIDevices)) {
+    if (CONFIG_QEMU && !PCIDeviceCount) {
         // No PCI devices found - probably a QEMU "-M isapc" machine.
         // Try using ISA ports for ATA controllers.
         init_controller(NULL, 0, IRQ_ATA1
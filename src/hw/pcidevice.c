@@ -13,33 +13,72 @@
 #include "stacks.h" // wait_preempt
 #include "string.h" // memset
 
-struct hlist_head PCIDevices VARVERIFY32INIT;
+struct pci_device *PCIDevices VARVERIFY32INIT;
+int PCIDeviceCount VARVERIFY32INIT;
 int MaxPCIBus VARFSEG;
 
-// Find all PCI devices and populate PCIDevices linked list.
+// Reserve a new entry at the end of the PCIDevices array.
+static struct pci_device *
+pci_device_alloc(int *maxdevs, struct pci_device **busdevs)
+{
+    if (PCIDeviceCount >= *maxdevs) {
+        // Grow array and update pointers into the old array.
+        int newmax = *maxdevs ? *maxdevs * 2 : 32;
+        struct pci_device *newdevs = malloc_tmp(sizeof(*newdevs) * newmax);
+        if (!newdevs) {
+            warn_noalloc();
+            return NULL;
+        }
+        struct pci_device *olddevs = PCIDevices;
+        memcpy(newdevs, olddevs, sizeof(*newdevs) * PCIDeviceCount);
+        int i;
+        for (i=0; i<PCIDeviceCount; i++)
+            if (newdevs[i].parent)
+                newdevs[i].parent = &newdevs[newdevs[i].parent - olddevs];
+        for (i=0; i<256; i++)
+            if (busdevs[i])
+                busdevs[i] = &newdevs[busdevs[i] - olddevs];
+        free(olddevs);
+        PCIDevices = newdevs;
+        *maxdevs = newmax;
+    }
+    struct pci_device *dev = &PCIDevices[PCIDeviceCount++];
+    memset(dev, 0, sizeof(*dev));
+    return dev;
+}
+
+// Find all PCI devices and populate PCIDevices array.
 void
 pci_probe_devices(void)
 {
     dprintf(3, "PCI probe\n");
     struct pci_device *busdevs[256];
     memset(busdevs, 0, sizeof(busdevs));
-    struct hlist_node **pprev = &PCIDevices.first;
+    int maxdevs = 0;
     int extraroots = romfile_loadint("etc/extra-pci-roots", 0);
-    int bus = -1, lastbus = 0, rootbuses = 0, count=0;
+    int bus = -1, lastbus = 0, rootbuses = 0;
     while (bus < 0xff && (bus < MaxPCIBus || rootbuses < extraroots)) {
         bus++;
-        int bdf;
-        foreachbdf(bdf, bus) {
-            // Create new pci_device struct and add to list.
-            struct pci_device *dev = malloc_tmp(sizeof(*dev));
-            if (!dev) {
-                warn_noalloc();
-                return;
+        int devfn;
+        for (devfn = 0; devfn < 0x100; devfn++) {
+            // Read the device id and header type only once per function
+            // and skip all functions of an absent or single function slot.
+            u16 bdf = pci_bus_devfn_to_bdf(bus, devfn);
+            u32 vendev = pci_config_readl(bdf, PCI_VENDOR_ID);
+            u16 vendor = vendev & 0xffff;
+            if (vendor == 0x0000 || vendor == 0xffff) {
+                if (pci_bdf_to_fn(bdf) == 0)
+                    devfn += 7;
+                continue;
             }
-            memset(dev, 0, sizeof(*dev));
-            hlist_add(&dev->node, pprev);
-            pprev = &dev->node.next;
-            count++;
+            u8 header_type = pci_config_readl(bdf, PCI_CACHE_LINE_SIZE) >> 16;
+            if (pci_bdf_to_fn(bdf) == 0 && !(header_type & 0x80))
+                devfn += 7;
+
+            // Create new pci_device struct and add to array.
+            struct pci_device *dev = pci_device_alloc(&maxdevs, busdevs);
+            if (!dev)
+                return;
 
             // Find parent device.
             int rootbus;
@@ -59,14 +98,13 @@ pci_probe_devices(void)
             dev->bdf = bdf;
             dev->parent = parent;
             dev->rootbus = rootbus;
-            u32 vendev = pci_config_readl(bdf, PCI_VENDOR_ID);
-            dev->vendor = vendev & 0xffff;
+            dev->vendor = vendor;
             dev->device = vendev >> 16;
             u32 classrev = pci_config_readl(bdf, PCI_CLASS_REVISION);
             dev->class = classrev >> 16;
             dev->prog_if = classrev >> 8;
             dev->revision = classrev & 0xff;
-            dev->header_type = pci_config_readb(bdf, PCI_HEADER_TYPE);
+            dev->header_type = header_type;
             u8 v = dev->header_type & 0x7f;
             if (v == PCI_HEADER_TYPE_BRIDGE || v == PCI_HEADER_TYPE_CARDBUS) {
                 u8 secbus = pci_config_readb(bdf, PCI_SECONDARY_BUS);
@@ -80,7 +118,8 @@ pci_probe_devices(void)
                     , dev, dev->vendor, dev->device, dev->class);
         }
     }
-    dprintf(1, "Found %d PCI devices (max PCI bus is %02x)\n", count, MaxPCIBus);
+    dprintf(1, "Found %d PCI devices (max PCI bus is %02x)\n"
+            , PCIDeviceCount, MaxPCIBus);
 }
 
 // Search for a device with the specified vendor and device ids.
@@ -2,12 +2,10 @@
 #define __PCIDEVICE_H
 
 #include "types.h" // u32
-#include "list.h" // hlist_node
 
 struct pci_device {
     u16 bdf;
     u8 rootbus;
-    struct hlist_node node;
     struct pci_device *parent;
 
     // Configuration space device information
@@ -20,15 +18,16 @@ struct pci_device {
     // Local information on device.
     int have_driver;
 };
-extern struct hlist_head PCIDevices;
+extern struct pci_device *PCIDevices;
+extern int PCIDeviceCount;
 extern int MaxPCIBus;
 
 static inline u32 pci_classprog(struct pci_device *pci) {
     return (pci->class << 8) | pci->prog_if;
 }
 
-#define foreachpci(PCI)                                 \
-    hlist_for_each_entry(PCI, &PCIDevices, node)
+#define foreachpci(PCI)                                         \
+    for (PCI = PCIDevices; PCI < &PCIDevices[PCIDeviceCount]; PCI++)
 
 #define PCI_ANY_ID      (~0)
 struct pci_device_id {
@@ -6,6 +6,7 @@
 
 #include "config.h" // CONFIG_DEBUG_SERIAL
 #include "fw/paravirt.h" // RunningOnQEMU
+#include "malloc.h" // malloc_tmphigh
 #include "output.h" // dprintf
 #include "serialio.h" // serial_debug_preinit
 #include "x86.h" // outb
@@ -39,6 +40,7 @@ serial_debug_read(u8 offset)
         ASSERT32FLAT();
         return readb((void*)CONFIG_DEBUG_SERIAL_MEM_ADDRESS + 4*offset);
     }
+    return 0;
 }
 
 // Setup the debug serial port for output.
@@ -61,12 +63,95 @@ serial_debug_preinit(void)
                 , oldparam, oldier, newparam, newier);
 }
 
+// Buffered output (32bit flat mode during POST only).  The indexes
+// are free running - the buffer size must be a power of 2.
+#define SERIAL_BUFFER_SIZE 8192
+#define SERIAL_FIFO_SIZE 16
+
+static char *SerialBuffer;
+static u32 SerialBufferHead, SerialBufferTail;
+static int SerialFifoSize;
+
+static int
+serial_buffering(void)
+{
+    return CONFIG_DEBUG_SERIAL_BUFFER && !MODESEGMENT && SerialBuffer;
+}
+
+// Send queued output to the serial port a FIFO load at a time (a
+// single byte at a time on parts without a FIFO).  Only
+// wait for the port if more than 'keep' bytes are still queued.
+static void
+serial_buffer_drain(u32 keep)
+{
+    for (;;) {
+        u32 pending = SerialBufferHead - SerialBufferTail;
+        if (!pending)
+            return;
+        if ((serial_debug_read(SEROFF_LSR) & 0x20) != 0x20) {
+            if (pending <= keep)
+                return;
+            int timeout = DEBUG_TIMEOUT;
+            while ((serial_debug_read(SEROFF_LSR) & 0x20) != 0x20)
+                if (!timeout--) {
+                    // Ran out of time - discard queued output.
+                    SerialBufferTail = SerialBufferHead;
+                    return;
+                }
+        }
+        // Transmit FIFO is empty - fill it.
+        int count = SerialFifoSize;
+        if (count > pending)
+            count = pending;
+        while (count--)
+            serial_debug_write(SEROFF_DATA, SerialBuffer[
+                                   SerialBufferTail++ % SERIAL_BUFFER_SIZE]);
+    }
+}
+
+// Start queuing debug output in memory.
+void
+serial_debug_buffer_setup(void)
+{
+    if (!CONFIG_DEBUG_SERIAL_BUFFER)
+        return;
+    ASSERT32FLAT();
+    SerialBuffer = malloc_tmphigh(SERIAL_BUFFER_SIZE);
+    if (!SerialBuffer)
+        return;
+    SerialBufferHead = SerialBufferTail = 0;
+    // Enable and clear the FIFOs - 8250/16450 parts don't have one.
+    serial_debug_write(SEROFF_FCR, 0x07);
+    SerialFifoSize = 1;
+    if ((serial_debug_read(SEROFF_IIR) & 0xc0) == 0xc0)
+        SerialFifoSize = SERIAL_FIFO_SIZE;
+    dprintf(3, "Buffering serial debug output (fifo size %d)\n"
+            , SerialFifoSize);
+}
+
+// Send all queued output and stop buffering.
+void
+serial_debug_buffer_finish(void)
+{
+    if (!serial_buffering())
+        return;
+    serial_debug_sync();
+    free(SerialBuffer);
+    SerialBuffer = NULL;
+}
+
 // Write a character to the serial port.
 static void
 serial_debug(char c)
 {
     if (!CONFIG_DEBUG_SERIAL && (!CONFIG_DEBUG_SERIAL_MMIO || MODESEGMENT))
         return;
+    if (serial_buffering()) {
+        if (SerialBufferHead - SerialBufferTail >= SERIAL_BUFFER_SIZE)
+            serial_buffer_drain(SERIAL_BUFFER_SIZE - SERIAL_FIFO_SIZE);
+        SerialBuffer[SerialBufferHead++ % SERIAL_BUFFER_SIZE] = c;
+        return;
+    }
     int timeout = DEBUG_TIMEOUT;
     while ((serial_debug_read(SEROFF_LSR) & 0x20) != 0x20)
         if (!timeout--)
@@ -83,12 +168,17 @@ serial_debug_putc(char c)
     serial_debug(c);
 }
 
-// Make sure all serial port writes have been completely sent.
+// Make sure all serial port writes have been completely sent.  When
+// buffering, just send what the port can take without waiting.
 void
 serial_debug_flush(void)
 {
     if (!CONFIG_DEBUG_SERIAL && (!CONFIG_DEBUG_SERIAL_MMIO || MODESEGMENT))
         return;
+    if (serial_buffering()) {
+        serial_buffer_drain(SERIAL_BUFFER_SIZE);
+        return;
+    }
     int timeout = DEBUG_TIMEOUT;
     while ((serial_debug_read(SEROFF_LSR) & 0x60) != 0x60)
         if (!timeout--)
@@ -96,6 +186,22 @@ serial_debug_flush(void)
             return;
 }
 
+// Send queued output while the port can take it without waiting.
+void
+serial_debug_poll(void)
+{
+    if (serial_buffering())
+        serial_buffer_drain(SERIAL_BUFFER_SIZE);
+}
+
+// Send all output queued in the buffer to the serial port.
+void
+serial_debug_sync(void)
+{
+    if (serial_buffering())
+        serial_buffer_drain(0);
+}
+
 
 /****************************************************************
  * QEMU debug port
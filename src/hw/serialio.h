@@ -16,6 +16,7 @@
 #define SEROFF_IER     1
 #define SEROFF_DLH     1
 #define SEROFF_IIR     2
+#define SEROFF_FCR     2
 #define SEROFF_LCR     3
 #define SEROFF_LSR     5
 #define SEROFF_MSR     6
@@ -23,6 +24,10 @@
 void serial_debug_preinit(void);
 void serial_debug_putc(char c);
 void serial_debug_flush(void);
+void serial_debug_poll(void);
+void serial_debug_sync(void);
+void serial_debug_buffer_setup(void);
+void serial_debug_buffer_finish(void);
 extern u16 DebugOutputPort;
 void qemu_debug_preinit(void);
 void qemu_debug_putc(char c);
@@ -786,9 +786,11 @@ static int xhci_event_wait(struct usb_xhci_s *xhci,
         xhci_process_events(xhci);
         if (!xhci_ring_busy(ring)) {
             u32 status = ring->evt.status;
+            dtrace("xhci event ring=%p status=%x\n", ring, status);
             return (status >> 24) & 0xff;
         }
         if (timer_check(end)) {
+            dtrace("xhci event ring=%p timeout\n", ring);
             warn_timeout();
             return -1;
         }
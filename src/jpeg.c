@@ -41,6 +41,7 @@
 
 #define __LITTLE_ENDIAN
 #include "malloc.h"
+#include "stacks.h"
 #include "string.h"
 #include "util.h"
 #define ISHIFT 11
@@ -120,6 +121,7 @@ static void initcol __P((PREC[][64]));
 static void col221111 __P((int *, unsigned char *, int));
 static void col221111_16 __P((int *, unsigned char *, int));
 static void col221111_32 __P((int *, unsigned char *, int));
+static void colmcu __P((int *, unsigned char *, int, int, int, int));
 
 /*********************************/
 
@@ -172,6 +174,8 @@ struct jpeg_decdata {
     int out[64 * 6];
     int dquant[3][64];
 
+    int mcuh, mcuv;  /* luma blocks per mcu (horizontal/vertical) */
+
     unsigned char *datap;
     struct jpginfo info;
     struct comp comps[MAXCOMP];
@@ -303,6 +307,7 @@ int jpeg_decode(struct jpeg_decdata *jpeg, unsigned char *buf)
     if (!jpeg || !buf)
         return -1;
     jpeg->datap = buf;
+    jpeg->info.dri = 0;  /* no restart interval unless a DRI marker is seen */
     if (getbyte(jpeg) != 0xff)
         return ERR_NO_SOI;
     if (getbyte(jpeg) != M_SOI)
@@ -315,8 +320,6 @@ int jpeg_decode(struct jpeg_decdata *jpeg, unsigned char *buf)
         return ERR_NOT_8BIT;
     jpeg->height = getword(jpeg);
     jpeg->width = getword(jpeg);
-    if ((jpeg->height & 15) || (jpeg->width & 15))
-        return ERR_BAD_WIDTH_OR_HEIGHT;
     jpeg->info.nc = getbyte(jpeg);
     if (jpeg->info.nc > MAXCOMP)
         return ERR_TOO_MANY_COMPPS;
@@ -367,9 +370,16 @@ int jpeg_decode(struct jpeg_decdata *jpeg, unsigned char *buf)
         || jpeg->dscans[2].cid != 3)
         return ERR_NOT_YCBCR_221111;
 
-    if (jpeg->dscans[0].hv != 0x22 || jpeg->dscans[1].hv != 0x11
-        || jpeg->dscans[2].hv != 0x11)
+    /* 4:2:0 (221111), 4:2:2 (211111) and 4:4:4 (111111) sampling */
+    if ((jpeg->dscans[0].hv != 0x22 && jpeg->dscans[0].hv != 0x21
+         && jpeg->dscans[0].hv != 0x11)
+        || jpeg->dscans[1].hv != 0x11 || jpeg->dscans[2].hv != 0x11)
         return ERR_NOT_YCBCR_221111;
+    jpeg->mcuh = jpeg->dscans[0].hv >> 4;
+    jpeg->mcuv = jpeg->dscans[0].hv & 15;
+    if ((jpeg->height & (jpeg->mcuv * 8 - 1))
+        || (jpeg->width & (jpeg->mcuh * 8 - 1)))
+        return ERR_BAD_WIDTH_OR_HEIGHT;
 
     idctqtab(jpeg->quant[jpeg->dscans[0].tq], jpeg->dquant[0]);
     idctqtab(jpeg->quant[jpeg->dscans[1].tq], jpeg->dquant[1]);
@@ -395,67 +405,65 @@ void jpeg_get_size(struct jpeg_decdata *jpeg, int *width, int *height)
     *height = jpeg->height;
 }
 
+/*
+ * Decode the image into 'pic' (which may be a linear framebuffer).
+ * Each row of mcus is colour converted into a small row buffer and
+ * then copied to its destination, so no full size intermediate image
+ * is needed.
+ */
 int jpeg_show(struct jpeg_decdata *jpeg, unsigned char *pic, int width
               , int height, int depth, int bytes_per_line_dest)
 {
-    int m, mcusx, mcusy, mx, my, mloffset, jpgbpl;
+    int m, mcusx, mcusy, mx, my, mloffset, jpgbpl, mcuw, mcuht, ny, b;
     int max[6];
 
     if (jpeg->height != height)
         return ERR_HEIGHT_MISMATCH;
     if (jpeg->width != width)
         return ERR_WIDTH_MISMATCH;
+    if (depth != 16 && depth != 24 && depth != 32)
+        return ERR_DEPTH_MISMATCH;
 
     jpgbpl = width * depth / 8;
     mloffset = bytes_per_line_dest > jpgbpl ? bytes_per_line_dest : jpgbpl;
 
-    mcusx = jpeg->width >> 4;
-    mcusy = jpeg->height >> 4;
+    mcuw = jpeg->mcuh * 8;
+    mcuht = jpeg->mcuv * 8;
+    mcusx = jpeg->width / mcuw;
+    mcusy = jpeg->height / mcuht;
+    ny = jpeg->mcuh * jpeg->mcuv;
 
-    jpeg->dscans[0].next = 6 - 4;
-    jpeg->dscans[1].next = 6 - 4 - 1;
-    jpeg->dscans[2].next = 6 - 4 - 1 - 1;        /* 411 encoding */
+    jpeg->dscans[0].next = 2;
+    jpeg->dscans[1].next = 1;
+    jpeg->dscans[2].next = 0;
     for (my = 0; my < mcusy; my++) {
         for (mx = 0; mx < mcusx; mx++) {
             if (jpeg->info.dri && !--jpeg->info.nm)
                 if (dec_checkmarker(jpeg))
                     return ERR_WRONG_MARKER;
 
-            decode_mcus(&jpeg->in, jpeg->dcts, 6, jpeg->dscans, max);
-            idct(jpeg->dcts, jpeg->out, jpeg->dquant[0],
-                 IFIX(128.5), max[0]);
-            idct(jpeg->dcts + 64, jpeg->out + 64, jpeg->dquant[0],
-                 IFIX(128.5), max[1]);
-            idct(jpeg->dcts + 128, jpeg->out + 128, jpeg->dquant[0],
-                 IFIX(128.5), max[2]);
-            idct(jpeg->dcts + 192, jpeg->out + 192, jpeg->dquant[0],
-                 IFIX(128.5), max[3]);
-            idct(jpeg->dcts + 256, jpeg->out + 256, jpeg->dquant[1],
-                 IFIX(0.5), max[4]);
-            idct(jpeg->dcts + 320, jpeg->out + 320, jpeg->dquant[2],
-                 IFIX(0.5), max[5]);
-
-            switch (depth) {
-            case 32:
-                col221111_32(jpeg->out,
-                             pic + (my * 16 * mloffset + mx * 16 * 4),
-                             mloffset);
-                break;
-            case 24:
-                col221111(jpeg->out,
-                          pic + (my * 16 * mloffset + mx * 16 * 3),
-                          mloffset);
-                break;
-            case 16:
-                col221111_16(jpeg->out,
-                             pic + (my * 16 * mloffset + mx * 16 * 2),
-                             mloffset);
-                break;
-            default:
-                return ERR_DEPTH_MISMATCH;
-                break;
-            }
+            decode_mcus(&jpeg->in, jpeg->dcts, ny + 2, jpeg->dscans, max);
+            for (b = 0; b < ny; b++)
+                idct(jpeg->dcts + b * 64, jpeg->out + b * 64,
+                     jpeg->dquant[0], IFIX(128.5), max[b]);
+            idct(jpeg->dcts + ny * 64, jpeg->out + ny * 64,
+                 jpeg->dquant[1], IFIX(0.5), max[ny]);
+            idct(jpeg->dcts + (ny + 1) * 64, jpeg->out + (ny + 1) * 64,
+                 jpeg->dquant[2], IFIX(0.5), max[ny + 1]);
+
+            unsigned char *p = pic + my * mcuht * mloffset
+                               + mx * mcuw * depth / 8;
+            if (ny != 4)
+                colmcu(jpeg->out, p, mloffset, depth,
+                       jpeg->mcuh, jpeg->mcuv);
+            else if (depth == 32)
+                col221111_32(jpeg->out, p, mloffset);
+            else if (depth == 24)
+                col221111(jpeg->out, p, mloffset);
+            else
+                col221111_16(jpeg->out, p, mloffset);
         }
+        yield();
     }
 
     m = dec_readmarker(&jpeg->in);
@@ -1053,3 +1061,41 @@ static void col221111_32(int *out, unsigned char *pic, int width)
         outy += 64 * 2 - 16 * 4;
     }
 }
+
+/*
+ * Colour convert an mcu with 'hs' x 'vs' luma blocks and one block
+ * each of Cb and Cr (4:4:4 and 4:2:2 sampling).
+ */
+static void colmcu(int *out, unsigned char *pic, int width, int depth,
+                   int hs, int vs)
+{
+    int px, py;
+    unsigned char *pic0;
+    int *outy, *outc;
+    int cr, cg, cb, y, d;
+
+    for (py = 0; py < vs * 8; py++) {
+        pic0 = pic + py * width;
+        outy = out + (py >> 3) * hs * 64 + (py & 7) * 8;
+        outc = out + hs * vs * 64 + (py >> (vs - 1)) * 8;
+        for (px = 0; px < hs * 8; px++) {
+            /* luma blocks are 64 entries apart */
+            int xin = px + (px & 8) * 7;
+            int xc = px >> (hs - 1);
+            CBCRCG(0, xc);
+            switch (depth) {
+            case 32:
+                PIC_32(0, xin, pic0, px);
+                break;
+            case 24:
+                PIC(0, xin, pic0, px);
+                break;
+            default:
+                /* same ordered dither as col221111_16 */
+                d = (py & 1) ? ((px & 1) ? 2 : 1) : ((px & 1) ? 0 : 3);
+                PIC_16(0, xin, pic0, px, d);
+                break;
+            }
+        }
+    }
+}
@@ -25,6 +25,7 @@ struct allocinfo_s {
 struct allocdetail_s {
     struct allocinfo_s detailinfo;
     struct allocinfo_s datainfo;
+    struct hlist_node datanode, handlenode;
     u32 handle;
 };
 
@@ -41,6 +42,12 @@ static struct zone_s *Zones[] VARVERIFY32INIT = {
     &ZoneTmpLow, &ZoneLow, &ZoneFSeg, &ZoneTmpHigh, &ZoneHigh
 };
 
+// Hash tables to find tracked allocations by data address and by handle.
+#define ALLOC_HASH_BITS 6
+#define ALLOC_HASH_SIZE (1 << ALLOC_HASH_BITS)
+static struct hlist_head AllocDataHash[ALLOC_HASH_SIZE] VARVERIFY32INIT;
+static struct hlist_head AllocHandleHash[ALLOC_HASH_SIZE] VARVERIFY32INIT;
+
 
 /****************************************************************
  * low-level memory reservations
@@ -129,21 +136,6 @@ alloc_free(struct allocinfo_s *info)
     hlist_del(&info->node);
 }
 
-// Search all zones for an allocation obtained from alloc_new()
-static struct allocinfo_s *
-alloc_find(u32 data)
-{
-    int i;
-    for (i=0; i<ARRAY_SIZE(Zones); i++) {
-        struct allocinfo_s *info;
-        hlist_for_each_entry(info, &Zones[i]->head, node) {
-            if (info->range_start == data)
-                return info;
-        }
-    }
-    return NULL;
-}
-
 // Find the lowest memory range added by alloc_add()
 static struct allocinfo_s *
 alloc_find_lowest(struct zone_s *zone)
@@ -156,6 +148,60 @@ alloc_find_lowest(struct zone_s *zone)
 }
 
 
+/****************************************************************
+ * allocation lookup
+ ****************************************************************/
+
+// Map a data address or pmm handle to a hash table slot
+static u32
+alloc_hash(u32 key)
+{
+    return (key * 0x9e3779b1) >> (32 - ALLOC_HASH_BITS);
+}
+
+// Add a tracked allocation to the lookup hash tables
+static void
+alloc_track(struct allocdetail_s *detail)
+{
+    hlist_add_head(&detail->datanode
+                   , &AllocDataHash[alloc_hash(detail->datainfo.range_start)]);
+    if (detail->handle != MALLOC_DEFAULT_HANDLE)
+        hlist_add_head(&detail->handlenode
+                       , &AllocHandleHash[alloc_hash(detail->handle)]);
+}
+
+// Remove a tracked allocation from the lookup hash tables
+static void
+alloc_untrack(struct allocdetail_s *detail)
+{
+    hlist_del(&detail->datanode);
+    if (detail->handle != MALLOC_DEFAULT_HANDLE)
+        hlist_del(&detail->handlenode);
+}
+
+// Find the tracked allocation starting at a given address
+static struct allocdetail_s *
+alloc_find(u32 data)
+{
+    struct allocdetail_s *detail;
+    hlist_for_each_entry(detail, &AllocDataHash[alloc_hash(data)], datanode) {
+        if (detail->datainfo.range_start == data)
+            return detail;
+    }
+    return NULL;
+}
+
+// Fixup hash table list heads after code relocation
+static void
+alloc_hash_relocate(struct hlist_head *table)
+{
+    int i;
+    for (i=0; i<ALLOC_HASH_SIZE; i++)
+        if (table[i].first)
+            table[i].first->pprev = &table[i].first;
+}
+
+
 /****************************************************************
  * ebda movement
  ****************************************************************/
@@ -255,6 +301,8 @@ malloc_palloc(struct zone_s *zone, u32 size, u32 align)
         return 0;
     }
 
+    alloc_track(detail);
+
     dprintf(8, "phys_alloc zone=%p size=%d align=%x ret=%x (detail=%p)\n"
             , zone, size, align, data, detail);
 
@@ -273,13 +321,12 @@ int
 malloc_pfree(u32 data)
 {
     ASSERT32FLAT();
-    struct allocinfo_s *info = alloc_find(data);
-    if (!info || data == virt_to_phys(info) || !info->alloc_size)
+    struct allocdetail_s *detail = alloc_find(data);
+    if (!detail)
         return -1;
-    struct allocdetail_s *detail = container_of(
-        info, struct allocdetail_s, datainfo);
     dprintf(8, "phys_free %x (detail=%p)\n", data, detail);
-    alloc_free(info);
+    alloc_untrack(detail);
+    alloc_free(&detail->datainfo);
     alloc_free(&detail->detailinfo);
     return 0;
 }
@@ -322,29 +369,23 @@ void
 malloc_sethandle(u32 data, u32 handle)
 {
     ASSERT32FLAT();
-    struct allocinfo_s *info = alloc_find(data);
-    if (!info || data == virt_to_phys(info) || !info->alloc_size)
+    struct allocdetail_s *detail = alloc_find(data);
+    if (!detail)
         return;
-    struct allocdetail_s *detail = container_of(
-        info, struct allocdetail_s, datainfo);
+    alloc_untrack(detail);
     detail->handle = handle;
+    alloc_track(detail);
 }
 
 // Find the data block allocated with phys_alloc with a given handle.
 u32
 malloc_findhandle(u32 handle)
 {
-    int i;
-    for (i=0; i<ARRAY_SIZE(Zones); i++) {
-        struct allocinfo_s *info;
-        hlist_for_each_entry(info, &Zones[i]->head, node) {
-            if (info->range_start != virt_to_phys(info))
-                continue;
-            struct allocdetail_s *detail = container_of(
-                info, struct allocdetail_s, detailinfo);
-            if (detail->handle == handle)
-                return detail->datainfo.range_start;
-        }
+    struct allocdetail_s *detail;
+    hlist_for_each_entry(detail, &AllocHandleHash[alloc_hash(handle)]
+                         , handlenode) {
+        if (detail->handle == handle)
+            return detail->datainfo.range_start;
     }
     return 0;
 }
@@ -500,6 +541,8 @@ malloc_init(void)
             if (zone->head.first)
                 zone->head.first->pprev = &zone->head.first;
         }
+        alloc_hash_relocate(AllocDataHash);
+        alloc_hash_relocate(AllocHandleHash);
     }
 
     // Initialize low-memory region
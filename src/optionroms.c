@@ -65,9 +65,10 @@ call_bcv(u16 seg, u16 ip)
     __callrom(MAKE_FLATPTR(seg, 0), ip, 0);
 }
 
-// Verify that an option rom looks valid
+// Verify that an option rom looks valid (using a precomputed checksum
+// of the rom if 'presum' is not negative)
 static int
-is_valid_rom(struct rom_header *rom)
+check_rom(struct rom_header *rom, int presum)
 {
     dprintf(6, "Checking rom %p (sig %x size %d)\n"
             , rom, rom->signature, rom->size);
@@ -76,7 +77,7 @@ is_valid_rom(struct rom_header *rom)
     if (! rom->size)
         return 0;
     u32 len = rom->size * 512;
-    u8 sum = checksum(rom, len);
+    u8 sum = presum >= 0 ? presum : checksum(rom, len);
     if (sum != 0) {
         dprintf(1, "Found option rom with bad checksum: loc=%p len=%d sum=%x\n"
                 , rom, len, sum);
@@ -86,6 +87,13 @@ is_valid_rom(struct rom_header *rom)
     return 1;
 }
 
+// Verify that an option rom looks valid
+static int
+is_valid_rom(struct rom_header *rom)
+{
+    return check_rom(rom, -1);
+}
+
 // Check if a valid option rom has a pnp struct; return it if so.
 static struct pnp_data *
 get_pnp_rom(struct rom_header *rom)
@@ -123,9 +131,9 @@ get_pci_rom(struct rom_header *rom)
 
 // Run rom init code and note rom size.
 static int
-init_optionrom(struct rom_header *rom, u16 bdf, int isvga)
+init_optionrom(struct rom_header *rom, u16 bdf, int isvga, int presum)
 {
-    if (! is_valid_rom(rom))
+    if (! check_rom(rom, presum))
         return -1;
     struct rom_header *newrom = rom_reserve(rom->size * 512);
     if (!newrom) {
@@ -177,19 +185,177 @@ getRomPriority(u64 *sources, struct rom_header *rom, int instance)
 }
 
 
+/****************************************************************
+ * Option rom preparation
+ ****************************************************************/
+
+// A romfile copied (and decompressed) ahead of option rom execution.
+struct rom_staging_s {
+    struct romfile_s *file;
+    void *data;
+    int ready;
+    int presum;
+};
+
+static struct rom_staging_s *StagedRoms;
+static int StagedRomCount;
+
+// Check if a romfile found in a CBFS rom directory should be deployed.
+static int
+is_file_rom_enabled(struct romfile_s *file, int pxen)
+{
+    return strcmp(file->name, "genroms/pxe.rom") == 0 && pxen == 1;
+}
+
+// Find the romfile for a given PCI device (if any).
+static struct romfile_s *
+find_pcirom_file(struct pci_device *pci)
+{
+    char fname[17];
+    snprintf(fname, sizeof(fname), "pci%04x,%04x.rom"
+             , pci->vendor, pci->device);
+    return romfile_find(fname);
+}
+
+// Thread to copy a romfile to the staging area and checksum it.
+static void
+stage_romfile(void *data)
+{
+    struct rom_staging_s *staged = data;
+    struct romfile_s *file = staged->file;
+    struct rom_header *rom = malloc_tmphigh(file->size);
+    if (!rom) {
+        warn_noalloc();
+        staged->ready = 1;
+        return;
+    }
+    int ret = file->copy(file, rom, file->size);
+    if (ret <= 0) {
+        free(rom);
+        staged->ready = 1;
+        return;
+    }
+    yield();
+    if (rom->signature == OPTION_ROM_SIGNATURE
+        && rom->size * 512 <= file->size)
+        staged->presum = checksum(rom, rom->size * 512);
+    dprintf(3, "Staged option rom '%s' (len %d)\n", file->name, ret);
+    staged->data = rom;
+    staged->ready = 1;
+}
+
+static void
+add_staged_rom(struct romfile_s *file)
+{
+    if (!file)
+        return;
+    int i;
+    for (i=0; i<StagedRomCount; i++)
+        if (StagedRoms[i].file == file)
+            // Already staged (multiple devices with the same ids)
+            return;
+    struct rom_staging_s *staged = &StagedRoms[StagedRomCount++];
+    staged->file = file;
+    staged->presum = -1;
+    run_thread(stage_romfile, staged);
+}
+
+// Start copying and decompressing (in threads) the romfiles that
+// optionrom_setup() will deploy, so that this overlaps with hardware init.
+void
+optionrom_prepare(void)
+{
+    if (! CONFIG_OPTIONROMS)
+        return;
+
+    // Count candidate romfiles.
+    int pxen = find_pxen(), count = 0;
+    struct romfile_s *file = NULL;
+    while ((file = romfile_findprefix("genroms/", file)))
+        if (is_file_rom_enabled(file, pxen))
+            count++;
+    struct pci_device *pci;
+    foreachpci(pci) {
+        if (pci->class != PCI_CLASS_DISPLAY_VGA
+            && pci->class != PCI_CLASS_DISPLAY_OTHER
+            && find_pcirom_file(pci))
+            count++;
+    }
+    if (!count)
+        return;
+    StagedRoms = malloc_tmp(sizeof(*StagedRoms) * count);
+    if (!StagedRoms) {
+        warn_noalloc();
+        return;
+    }
+    memset(StagedRoms, 0, sizeof(*StagedRoms) * count);
+
+    // Start staging threads.
+    foreachpci(pci) {
+        if (pci->class != PCI_CLASS_DISPLAY_VGA
+            && pci->class != PCI_CLASS_DISPLAY_OTHER)
+            add_staged_rom(find_pcirom_file(pci));
+    }
+    while ((file = romfile_findprefix("genroms/", file)))
+        if (is_file_rom_enabled(file, pxen))
+            add_staged_rom(file);
+}
+
+// Find (and wait for) the staged copy of a romfile.
+static struct rom_staging_s *
+find_staged_rom(struct romfile_s *file)
+{
+    int i;
+    for (i=0; i<StagedRomCount; i++) {
+        struct rom_staging_s *staged = &StagedRoms[i];
+        if (staged->file != file)
+            continue;
+        while (!staged->ready)
+            yield();
+        return staged;
+    }
+    return NULL;
+}
+
+// Release the staging area.
+static void
+free_staged_roms(void)
+{
+    int i;
+    for (i=0; i<StagedRomCount; i++) {
+        struct rom_staging_s *staged = &StagedRoms[i];
+        while (!staged->ready)
+            yield();
+        free(staged->data);
+    }
+    free(StagedRoms);
+    StagedRoms = NULL;
+    StagedRomCount = 0;
+}
+
+
 /****************************************************************
  * Roms in CBFS
  ****************************************************************/
 
 static struct rom_header *
-deploy_romfile(struct romfile_s *file)
+deploy_romfile(struct romfile_s *file, int *presum)
 {
+    *presum = -1;
     u32 size = file->size;
     struct rom_header *rom = rom_reserve(size);
     if (!rom) {
         warn_noalloc();
         return NULL;
     }
+    struct rom_staging_s *staged = find_staged_rom(file);
+    if (staged) {
+        if (!staged->data)
+            return NULL;
+        memcpy(rom, staged->data, size);
+        *presum = staged->presum;
+        return rom;
+    }
     int ret = file->copy(file, rom, size);
     if (ret <= 0)
         return NULL;
@@ -206,11 +372,12 @@ run_file_roms(const char *prefix, int isvga, u64 *sources)
         file = romfile_findprefix(prefix, file);
         if (!file)
             break;
-        if ((strcmp(file->name, "genroms/pxe.rom") == 0) && (pxen == 1)) {
-            struct rom_header *rom = deploy_romfile(file);
+        if (is_file_rom_enabled(file, pxen)) {
+            int presum;
+            struct rom_header *rom = deploy_romfile(file, &presum);
             if (rom) {
                 setRomSource(sources, rom, (u32)file);
-                init_optionrom(rom, 0, isvga);
+                init_optionrom(rom, 0, isvga, presum);
             }
         }
     }
@@ -343,13 +510,11 @@ init_pcirom(struct pci_device *pci, int isvga, u64 *sources)
     dprintf(4, "Attempting to init PCI bdf %pP (vd %04x:%04x)\n"
             , pci, pci->vendor, pci->device);
 
-    char fname[17];
-    snprintf(fname, sizeof(fname), "pci%04x,%04x.rom"
-             , pci->vendor, pci->device);
-    struct romfile_s *file = romfile_find(fname);
+    struct romfile_s *file = find_pcirom_file(pci);
     struct rom_header *rom = NULL;
+    int presum = -1;
     if (file)
-        rom = deploy_romfile(file);
+        rom = deploy_romfile(file, &presum);
     else if (RunPCIroms > 1 || (RunPCIroms == 1 && isvga))
         rom = map_pcirom(pci);
     if (! rom)
@@ -358,7 +523,7 @@ init_pcirom(struct pci_device *pci, int isvga, u64 *sources)
     int irq_was_captured = boot_irq_captured();
     struct pnp_data *pnp = get_pnp_rom(rom);
     setRomSource(sources, rom, RS_PCIROM | (u32)pci);
-    init_optionrom(rom, pci->bdf, isvga);
+    init_optionrom(rom, pci->bdf, isvga, presum);
     if (boot_irq_captured() && !irq_was_captured &&
         !file && !isvga && pnp) {
         // This PCI rom is misbehaving - recapture the boot irqs
@@ -398,6 +563,7 @@ optionrom_setup(void)
     // Find and deploy CBFS roms not associated with a device.
     run_file_roms("genroms/", 0, sources);
     rom_reserve(0);
+    free_staged_roms();
 
     // All option roms found and deployed - now build BEV/BCV vectors.
 
@@ -455,7 +621,7 @@ static void try_setup_display_other(void)
         dprintf(1, "Other display found at %pP\n", pci);
         pci_config_maskw(pci->bdf, PCI_COMMAND, 0,
                          PCI_COMMAND_IO | PCI_COMMAND_MEMORY);
-        init_optionrom(rom, pci->bdf, 1);
+        init_optionrom(rom, pci->bdf, 1, -1);
         return;
     }
 }
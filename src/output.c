@@ -335,6 +335,9 @@ panic(const char *fmt, ...)
         va_start(args, fmt);
         bvprintf(&debuginfo, fmt, args);
         va_end(args);
+        if (CONFIG_DEBUG_TRACE && !MODESEGMENT)
+            trace_dump();
+        serial_debug_sync();
         debug_flush();
     }
 
@@ -444,6 +447,86 @@ znprintf(size_t size, const char *fmt, ...)
 }
 
 
+/****************************************************************
+ * Binary trace buffer
+ ****************************************************************/
+
+#define TRACE_SIGNATURE 0x45435254 // TRCE
+#define TRACE_ENTRIES 512
+
+struct trace_entry {
+    u32 fmt;
+    u32 args[4];
+};
+
+struct trace_buffer {
+    u32 signature;
+    u32 count;
+    u32 size;
+    s32 init_delta;
+    struct trace_entry entries[TRACE_ENTRIES];
+};
+
+static struct trace_buffer *TraceBuffer;
+
+// Record a trace event - the format string is only expanded offline.
+void
+__dtrace(const char *fmt, u32 a0, u32 a1, u32 a2, u32 a3)
+{
+    ASSERT32FLAT();
+    struct trace_buffer *tb = TraceBuffer;
+    if (!tb)
+        return;
+    struct trace_entry *te = &tb->entries[tb->count++ % TRACE_ENTRIES];
+    te->fmt = (u32)fmt;
+    te->args[0] = a0;
+    te->args[1] = a1;
+    te->args[2] = a2;
+    te->args[3] = a3;
+}
+
+// Allocate the trace buffer (in reserved memory so it survives boot).
+void
+trace_setup(void)
+{
+    if (!CONFIG_DEBUG_TRACE)
+        return;
+    struct trace_buffer *tb = malloc_high(sizeof(*tb));
+    if (!tb) {
+        warn_noalloc();
+        return;
+    }
+    memset(tb, 0, sizeof(*tb));
+    tb->signature = TRACE_SIGNATURE;
+    tb->size = TRACE_ENTRIES;
+    tb->init_delta = InitRelocDelta;
+    dprintf(1, "Trace buffer at %p\n", tb);
+    TraceBuffer = tb;
+}
+
+// Write the trace buffer contents (oldest first) to the debug output.
+void
+trace_dump(void)
+{
+    ASSERT32FLAT();
+    struct trace_buffer *tb = TraceBuffer;
+    if (!tb)
+        return;
+    TraceBuffer = NULL;
+    u32 count = tb->count, i = 0;
+    if (count > TRACE_ENTRIES)
+        i = count - TRACE_ENTRIES;
+    dprintf(1, "trace: count=%d size=%d delta=%x\n"
+            , count, TRACE_ENTRIES, tb->init_delta);
+    for (; i < count; i++) {
+        struct trace_entry *te = &tb->entries[i % TRACE_ENTRIES];
+        dprintf(1, "trace: %x %x %x %x %x\n", te->fmt
+                , te->args[0], te->args[1], te->args[2], te->args[3]);
+    }
+    TraceBuffer = tb;
+}
+
+
 /****************************************************************
  * Misc helpers
  ****************************************************************/
@@ -31,11 +31,21 @@ void __set_code_invalid(struct bregs *regs, u32 linecode, const char *fname);
 void __set_code_unimplemented(struct bregs *regs, u32 linecode
                               , const char *fname);
 void hexdump(const void *d, int len);
+void __dtrace(const char *fmt, u32 a0, u32 a1, u32 a2, u32 a3);
+void trace_setup(void);
+void trace_dump(void);
 
 #define dprintf(lvl, fmt, args...) do {                         \
         if (CONFIG_DEBUG_LEVEL && (lvl) <= CONFIG_DEBUG_LEVEL)  \
             __dprintf((fmt) , ##args );                         \
     } while (0)
+// Record a trace event (at most four integer/pointer arguments).
+#define dtrace(fmt, args...)                    \
+    __dtrace4((fmt) , ##args , 0, 0, 0, 0)
+#define __dtrace4(fmt, a0, a1, a2, a3, rest...) do {                    \
+        if (CONFIG_DEBUG_TRACE && !MODESEGMENT)                         \
+            __dtrace((fmt), (u32)(a0), (u32)(a1), (u32)(a2), (u32)(a3)); \
+    } while (0)
 #define debug_enter(regs, lvl) do {                     \
         if ((lvl) && (lvl) <= CONFIG_DEBUG_LEVEL)       \
             __debug_enter((regs), __func__);            \
@@ -104,6 +104,8 @@ interface_init(void)
 {
     // Running at new code address - do code relocation fixups
     malloc_init();
+    serial_debug_buffer_setup();
+    trace_setup();
 
     // Setup romfile items.
     qemu_cfg_init();
@@ -171,6 +173,8 @@ prepareboot(void)
     // Finalize data structures before boot
     cdrom_prepboot();
     pmm_prepboot();
+    mtrr_prepboot();
+    serial_debug_buffer_finish();
     malloc_prepboot();
     e820_prepboot();
 
@@ -205,17 +209,23 @@ maininit(void)
     platform_hardware_setup();
 
     // Start hardware initialization (if threads allowed during optionroms)
-    if (threads_during_optionroms())
+    if (threads_during_optionroms()) {
         device_hardware_setup();
+        optionrom_prepare();
+    }
 
     // Run vga option rom
     vgarom_setup();
     sercon_setup();
     enable_vga_console();
 
+    // Start decoding the boot splash (runs alongside hardware init)
+    bootsplash_setup();
+
     // Do hardware initialization (if running synchronously)
     if (!threads_during_optionroms()) {
         device_hardware_setup();
+        optionrom_prepare();
         wait_threads();
     }
 
@@ -250,6 +260,9 @@ updateRelocs(void *dest, u32 *rstart, u32 *rend, u32 delta)
         *((u32*)(dest + *reloc)) += delta;
 }
 
+// Offset of the relocated init code from its link address.
+s32 InitRelocDelta VARVERIFY32INIT;
+
 // Relocate init code and then call a function at its new address.
 // The passed function should be in the "init" section and must not
 // return.
@@ -272,6 +285,7 @@ reloc_preinit(void *f, void *arg)
     dprintf(1, "Relocating init from %p to %p (size %d)\n"
             , codesrc, codedest, initsize);
     s32 delta = codedest - codesrc;
+    InitRelocDelta = delta;
     memcpy(codedest, codesrc, initsize);
     updateRelocs(codedest, VSYMBOL(_reloc_abs_start), VSYMBOL(_reloc_abs_end)
                  , delta);
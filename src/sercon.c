@@ -53,20 +53,33 @@ VARLOW u8 sercon_enable;
 VARFSEG struct segoff_s sercon_real_vga_handler;
 
 /*
- * We have a small output buffer here, for lazy output.  That allows
- * to avoid a whole bunch of control sequences for pointless cursor
- * moves, so when logging the output it'll be *alot* less cluttered.
+ * The screen contents are kept in a shadow buffer (in low memory).
+ * INT10 calls only update the shadow and record which cells changed
+ * (a range of dirty columns per row); the changes are sent to the
+ * terminal when input is polled or on the next timer tick.  That
+ * coalesces updates and avoids a whole bunch of control sequences for
+ * pointless cursor moves, so when logging the output it'll be *alot*
+ * less cluttered.  Scrolling uses terminal scroll regions.
  *
- * sercon_char/attr  is the actual output buffer.
+ * sercon_shadow     is the shadow buffer (char | attr << 8 per cell).
+ * sercon_dirty_*    is the first/last changed column of each row.
  * sercon_attr_last  is the most recent attribute sent to the terminal.
  * sercon_col_last   is the most recent column sent to the terminal.
  * sercon_row_last   is the most recent row sent to the terminal.
  */
+#define SERCON_ROWS    25
+#define SERCON_COLS    80
+#define SERCON_CLEAN   0xff
+#define SERCON_UNKNOWN 0xff
+
+VARLOW u16 *sercon_shadow;
+VARLOW u8 sercon_dirty;
+VARLOW u8 sercon_dirty_first[SERCON_ROWS];
+VARLOW u8 sercon_dirty_last[SERCON_ROWS];
+VARLOW u8 sercon_busy;
 VARLOW u8 sercon_attr_last;
 VARLOW u8 sercon_col_last;
 VARLOW u8 sercon_row_last;
-VARLOW u8 sercon_char;
-VARLOW u8 sercon_attr = 0x07;
 
 static VAR16 u8 sercon_cmap[8] = { '0', '4', '2', '6', '1', '5', '3', '7' };
 
@@ -137,6 +150,24 @@ static void sercon_term_cursor_goto(u8 row, u8 col)
     sercon_putchar('H');
 }
 
+/* Set the scroll region, or reset it to the full screen if bottom == 0 */
+static void sercon_term_scroll_region(u8 top, u8 bottom)
+{
+    sercon_putchar('\x1b');
+    sercon_putchar('[');
+    if (bottom) {
+        top++; bottom++;
+        sercon_putchar('0' + top / 10);
+        sercon_putchar('0' + top % 10);
+        sercon_putchar(';');
+        sercon_putchar('0' + bottom / 10);
+        sercon_putchar('0' + bottom % 10);
+    }
+    sercon_putchar('r');
+    /* this homes the cursor */
+    SET_LOW(sercon_row_last, SERCON_UNKNOWN);
+}
+
 static void sercon_term_set_color(u8 fg, u8 bg, u8 bold)
 {
     sercon_putchar('\x1b');
@@ -195,27 +226,31 @@ static void sercon_cursor_pos_set(u8 row, u8 col)
     }
 }
 
-static void sercon_lazy_cursor_sync(void)
+/* Move the terminal cursor, using short sequences where possible */
+static void sercon_term_move(u8 row, u8 col)
 {
-    u8 row = cursor_pos_row();
-    u8 col = cursor_pos_col();
+    u8 row_last = GET_LOW(sercon_row_last);
+    u8 col_last = GET_LOW(sercon_col_last);
 
-    if (GET_LOW(sercon_row_last) == row &&
-        GET_LOW(sercon_col_last) == col)
+    if (row_last == row && col_last == col)
         return;
 
-    if (col == 0 && GET_LOW(sercon_row_last) <= row) {
-        if (GET_LOW(sercon_col_last) != 0) {
-            sercon_putchar('\r');
-            SET_LOW(sercon_col_last, 0);
-        }
-        while (GET_LOW(sercon_row_last) < row) {
-            sercon_putchar('\n');
-            SET_LOW(sercon_row_last, GET_LOW(sercon_row_last)+1);
+    if (row_last != SERCON_UNKNOWN && col_last != SERCON_UNKNOWN) {
+        if (col == 0 && row_last <= row && row - row_last < 4) {
+            if (col_last != 0)
+                sercon_putchar('\r');
+            for (; row_last < row; row_last++)
+                sercon_putchar('\n');
+            SET_LOW(sercon_row_last, row);
+            SET_LOW(sercon_col_last, col);
+            return;
         }
-        if (GET_LOW(sercon_row_last) == row &&
-            GET_LOW(sercon_col_last) == col)
+        if (row_last == row && col < col_last && col_last - col < 4) {
+            for (; col < col_last; col_last--)
+                sercon_putchar(8);
+            SET_LOW(sercon_col_last, col);
             return;
+        }
     }
 
     sercon_term_cursor_goto(row, col);
@@ -223,43 +258,187 @@ static void sercon_lazy_cursor_sync(void)
     SET_LOW(sercon_col_last, col);
 }
 
-static void sercon_lazy_flush(void)
+/* Send one cell to the terminal */
+static void sercon_term_cell(u8 row, u8 col, u16 cell)
 {
-    u8 chr, attr;
+    sercon_term_move(row, col);
+    sercon_set_attr(cell >> 8);
+    sercon_print_utf8(cell);
+    col++;
+    /* the cursor doesn't advance past the last column (no linewrap) */
+    SET_LOW(sercon_col_last, col < video_cols() ? col : SERCON_UNKNOWN);
+}
 
-    chr = GET_LOW(sercon_char);
-    attr = GET_LOW(sercon_attr);
-    if (chr) {
-        sercon_set_attr(attr);
-        sercon_print_utf8(chr);
-        SET_LOW(sercon_col_last, GET_LOW(sercon_col_last) + 1);
-    }
+static int sercon_shadow_ok(void)
+{
+    return (GET_LOW(sercon_shadow) && video_rows() <= SERCON_ROWS
+            && video_cols() <= SERCON_COLS);
+}
+
+static u16 *sercon_cell(u8 row, u8 col)
+{
+    return &GET_LOW(sercon_shadow)[row * SERCON_COLS + col];
+}
 
-    sercon_lazy_cursor_sync();
+static u16 sercon_cell_get(u8 row, u8 col)
+{
+    if (!sercon_shadow_ok())
+        return 0x0720;
+    return GET_LOWFLAT(*sercon_cell(row, col));
+}
 
-    SET_LOW(sercon_attr, 0x07);
-    SET_LOW(sercon_char, 0x00);
+/* Store a cell in the shadow buffer and mark it dirty if it changed */
+static void sercon_cell_set(u8 row, u8 col, u16 cell)
+{
+    if (!sercon_shadow_ok()) {
+        /* no shadow for this mode - send it right away */
+        sercon_term_cell(row, col, cell);
+        return;
+    }
+    u16 *p = sercon_cell(row, col);
+    if (GET_LOWFLAT(*p) == cell)
+        return;
+    SET_LOWFLAT(*p, cell);
+
+    u8 first = GET_LOW(sercon_dirty_first[row]);
+    if (first == SERCON_CLEAN) {
+        SET_LOW(sercon_dirty_first[row], col);
+        SET_LOW(sercon_dirty_last[row], col);
+    } else if (col < first) {
+        SET_LOW(sercon_dirty_first[row], col);
+    } else if (col > GET_LOW(sercon_dirty_last[row])) {
+        SET_LOW(sercon_dirty_last[row], col);
+    }
+    SET_LOW(sercon_dirty, 1);
 }
 
-static void sercon_lazy_cursor_update(u8 row, u8 col)
+/* Fill the whole shadow buffer (the terminal already shows 'cell') */
+static void sercon_shadow_fill(u16 cell)
 {
-    sercon_cursor_pos_set(row, col);
-    SET_LOW(sercon_row_last, row);
-    SET_LOW(sercon_col_last, col);
+    u16 *shadow = GET_LOW(sercon_shadow);
+    if (!shadow)
+        return;
+    int i;
+    for (i = 0; i < SERCON_ROWS * SERCON_COLS; i++)
+        SET_LOWFLAT(shadow[i], cell);
+    for (i = 0; i < SERCON_ROWS; i++)
+        SET_LOW(sercon_dirty_first[i], SERCON_CLEAN);
+    SET_LOW(sercon_dirty, 0);
+}
+
+/* Send all changed cells to the terminal and sync the cursor */
+static void sercon_flush(void)
+{
+    if (GET_LOW(sercon_dirty)) {
+        SET_LOW(sercon_dirty, 0);
+        u8 row, col, rows = video_rows();
+        if (rows > SERCON_ROWS)
+            rows = SERCON_ROWS;
+        for (row = 0; row < rows; row++) {
+            u8 first = GET_LOW(sercon_dirty_first[row]);
+            if (first == SERCON_CLEAN)
+                continue;
+            u8 last = GET_LOW(sercon_dirty_last[row]);
+            SET_LOW(sercon_dirty_first[row], SERCON_CLEAN);
+            for (col = first; col <= last; col++)
+                sercon_term_cell(row, col, GET_LOWFLAT(*sercon_cell(row, col)));
+        }
+    }
+    sercon_term_move(cursor_pos_row(), cursor_pos_col());
 }
 
-static void sercon_lazy_backspace(void)
+static void sercon_clear(u8 attr)
 {
-    u8 col;
+    sercon_shadow_fill(' ' | (attr << 8));
+    sercon_set_attr(attr);
+    sercon_term_clear_screen();
+}
 
-    sercon_lazy_flush();
-    col = cursor_pos_col();
-    if (col > 0) {
-        sercon_putchar(8);
-        sercon_lazy_cursor_update(cursor_pos_row(), col-1);
+/* Scroll (or clear, if nr == 0) a window up or down */
+static void sercon_scroll(u8 nr, u8 attr, u8 top, u8 left
+                          , u8 bottom, u8 right, int up)
+{
+    u8 rows = video_rows(), cols = video_cols();
+    if (bottom >= rows)
+        bottom = rows - 1;
+    if (right >= cols)
+        right = cols - 1;
+    if (top > bottom || left > right)
+        return;
+    u8 lines = bottom - top + 1;
+    int fullwidth = left == 0 && right == cols - 1;
+    if (!nr || nr >= lines) {
+        if (fullwidth && lines == rows) {
+            sercon_clear(attr);
+            return;
+        }
+        nr = lines;
+    }
+    u16 blank = ' ' | (attr << 8);
+    u8 row, col;
+
+    if (!sercon_shadow_ok()) {
+        /* no shadow - only plain full screen scrolling is supported */
+        if (fullwidth && lines == rows && up && nr < lines) {
+            sercon_term_move(bottom, 0);
+            while (nr--)
+                sercon_putchar('\n');
+        }
+        return;
+    }
+
+    if (fullwidth && nr < lines) {
+        /* let the terminal scroll, then shift the (clean) shadow rows */
+        sercon_flush();
+        sercon_set_attr(attr);
+        if (lines != rows)
+            sercon_term_scroll_region(top, bottom);
+        if (up) {
+            sercon_term_move(bottom, 0);
+            for (col = 0; col < nr; col++)
+                sercon_putchar('\n');
+        } else {
+            sercon_term_move(top, 0);
+            for (col = 0; col < nr; col++) {
+                sercon_putchar('\x1b');
+                sercon_putchar('M');
+            }
+        }
+        if (lines != rows)
+            sercon_term_scroll_region(0, 0);
+        for (row = 0; row < lines; row++) {
+            u8 dst = up ? top + row : bottom - row;
+            u8 src = up ? dst + nr : dst - nr;
+            for (col = 0; col < cols; col++)
+                SET_LOWFLAT(*sercon_cell(dst, col), row < lines - nr
+                            ? GET_LOWFLAT(*sercon_cell(src, col)) : blank);
+            /* terminals may fill with the default background */
+            if (row >= lines - nr && (attr & 0x70)) {
+                SET_LOW(sercon_dirty_first[dst], 0);
+                SET_LOW(sercon_dirty_last[dst], cols - 1);
+                SET_LOW(sercon_dirty, 1);
+            }
+        }
+        return;
+    }
+
+    /* partial window - move the cells and let the diff sort it out */
+    for (row = 0; row < lines; row++) {
+        u8 dst = up ? top + row : bottom - row;
+        u8 src = up ? dst + nr : dst - nr;
+        for (col = left; col <= right; col++)
+            sercon_cell_set(dst, col, row < lines - nr
+                            ? sercon_cell_get(src, col) : blank);
     }
 }
 
+static void sercon_lazy_backspace(void)
+{
+    u8 col = cursor_pos_col();
+    if (col > 0)
+        sercon_cursor_pos_set(cursor_pos_row(), col-1);
+}
+
 static void sercon_lazy_cr(void)
 {
     sercon_cursor_pos_set(cursor_pos_row(), 0);
@@ -273,9 +452,7 @@ static void sercon_lazy_lf(void)
     if (row >= video_rows()) {
         /* scrolling up */
         row = video_rows()-1;
-        if (GET_LOW(sercon_row_last) > 0) {
-            SET_LOW(sercon_row_last, GET_LOW(sercon_row_last) - 1);
-        }
+        sercon_scroll(1, 0x07, 0, 0, row, video_cols()-1, 1);
     }
     sercon_cursor_pos_set(row, cursor_pos_col());
 }
@@ -293,18 +470,12 @@ static void sercon_lazy_move_cursor(void)
     }
 }
 
-static void sercon_lazy_putchar(u8 chr, u8 attr, u8 teletype)
+/* Teletype character - keeps the attribute already on screen */
+static void sercon_lazy_putchar(u8 chr)
 {
-    if (cursor_pos_row() != GET_LOW(sercon_row_last) ||
-        cursor_pos_col() != GET_LOW(sercon_col_last)) {
-        sercon_lazy_flush();
-    }
-
-    SET_LOW(sercon_char, chr);
-    if (teletype)
-        sercon_lazy_move_cursor();
-    else
-        SET_LOW(sercon_attr, attr);
+    u8 row = cursor_pos_row(), col = cursor_pos_col();
+    sercon_cell_set(row, col, (sercon_cell_get(row, col) & 0xff00) | chr);
+    sercon_lazy_move_cursor();
 }
 
 /* Set video mode */
@@ -350,6 +521,7 @@ static void sercon_1000(struct bregs *regs)
 
     sercon_term_reset();
     sercon_term_no_linewrap();
+    sercon_shadow_fill(0x0720);
 
     if (clearscreen) {
          sercon_term_clear_screen();
@@ -380,55 +552,44 @@ static void sercon_1003(struct bregs *regs)
 /* Scroll up window */
 static void sercon_1006(struct bregs *regs)
 {
-    sercon_lazy_flush();
-    if (regs->al == 0) {
-        /* clear rect, do only in case this looks like a fullscreen clear */
-        if (regs->ch == 0 &&
-            regs->cl == 0 &&
-            regs->dh == video_rows()-1 &&
-            regs->dl == video_cols()-1) {
-            sercon_set_attr(regs->bh);
-            sercon_term_clear_screen();
-        }
-    } else {
-        sercon_putchar('\r');
-        sercon_putchar('\n');
-    }
+    sercon_scroll(regs->al, regs->bh, regs->ch, regs->cl,
+                  regs->dh, regs->dl, 1);
+}
+
+/* Scroll down window */
+static void sercon_1007(struct bregs *regs)
+{
+    sercon_scroll(regs->al, regs->bh, regs->ch, regs->cl,
+                  regs->dh, regs->dl, 0);
 }
 
 /* Read character and attribute at cursor position */
 static void sercon_1008(struct bregs *regs)
 {
-    regs->ah = 0x07;
-    regs->bh = ' ';
+    regs->ax = sercon_cell_get(cursor_pos_row(), cursor_pos_col());
 }
 
 /* Write character and attribute at cursor position */
 static void sercon_1009(struct bregs *regs)
 {
     u16 count = regs->cx;
+    u8 row = cursor_pos_row(), col = cursor_pos_col();
+    u8 rows = video_rows(), cols = video_cols();
 
-    if (count == 1) {
-        sercon_lazy_putchar(regs->al, regs->bl, 0);
-
-    } else if (regs->al == 0x20 &&
-               video_rows() * video_cols() == count &&
-               cursor_pos_row() == 0 &&
-               cursor_pos_col() == 0) {
+    if (regs->al == 0x20 &&
+        rows * cols == count &&
+        row == 0 && col == 0) {
         /* override everything with spaces -> this is clear screen */
-        sercon_lazy_flush();
-        sercon_set_attr(regs->bl);
-        sercon_term_clear_screen();
+        sercon_clear(regs->bl);
+        return;
+    }
 
-    } else {
-        sercon_lazy_flush();
-        sercon_set_attr(regs->bl);
-        while (count) {
-            sercon_print_utf8(regs->al);
-            count--;
+    while (count-- && row < rows) {
+        sercon_cell_set(row, col, regs->al | (regs->bl << 8));
+        if (++col >= cols) {
+            col = 0;
+            row++;
         }
-        sercon_term_cursor_goto(cursor_pos_row(),
-                                cursor_pos_col());
     }
 }
 
@@ -449,7 +610,7 @@ static void sercon_100e(struct bregs *regs)
         sercon_lazy_lf();
         break;
     default:
-        sercon_lazy_putchar(regs->al, 0, 1);
+        sercon_lazy_putchar(regs->al);
         break;
     }
 }
@@ -497,12 +658,14 @@ handle_sercon(struct bregs *regs)
             return;
     }
 
+    SET_LOW(sercon_busy, 1);
     switch (regs->ah) {
     case 0x00: sercon_1000(regs); break;
     case 0x01: sercon_1001(regs); break;
     case 0x02: sercon_1002(regs); break;
     case 0x03: sercon_1003(regs); break;
     case 0x06: sercon_1006(regs); break;
+    case 0x07: sercon_1007(regs); break;
     case 0x08: sercon_1008(regs); break;
     case 0x09: sercon_1009(regs); break;
     case 0x0e: sercon_100e(regs); break;
@@ -510,6 +673,7 @@ handle_sercon(struct bregs *regs)
     case 0x4f: sercon_104f(regs); break;
     default:   sercon_10XX(regs); break;
     }
+    SET_LOW(sercon_busy, 0);
 }
 
 void sercon_setup(void)
@@ -557,6 +721,13 @@ void sercon_setup(void)
         SET_LOW(sercon_port, addr);
         outb(0x03, addr + SEROFF_LCR); // 8N1
         outb(0x01, addr + 0x02);       // enable fifo
+        u16 *shadow = malloc_low(SERCON_ROWS * SERCON_COLS * sizeof(*shadow));
+        if (shadow) {
+            SET_LOW(sercon_shadow, shadow);
+            sercon_shadow_fill(0x0720);
+        } else {
+            warn_noalloc();
+        }
     }
 }
 
@@ -650,8 +821,9 @@ sercon_check_event(void)
     if (inb(addr + SEROFF_LSR) == 0xFF)
         return;
 
-    // flush pending output
-    sercon_lazy_flush();
+    // flush pending output (unless called from within the int10 handler)
+    if (GET_LOW(sercon_enable) && !GET_LOW(sercon_busy))
+        sercon_flush();
 
     // read all available data
     while (inb(addr + SEROFF_LSR) & 0x01) {
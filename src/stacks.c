@@ -8,6 +8,7 @@
 #include "bregs.h" // CR0_PE
 #include "fw/paravirt.h" // PORT_SMI_CMD
 #include "hw/rtc.h" // rtc_use
+#include "hw/serialio.h" // serial_debug_poll
 #include "list.h" // hlist_node
 #include "malloc.h" // free
 #include "output.h" // dprintf
@@ -525,6 +526,7 @@ switch_next(struct thread_info *cur)
     if (cur == next)
         // Nothing to do.
         return;
+    dtrace("switch thread %p -> %p\n", cur, next);
     asm volatile(
         "  pushl $1f\n"                 // store return pc
         "  pushl %%ebp\n"               // backup %ebp
@@ -600,6 +602,8 @@ fail:
 void VISIBLE16
 check_irqs(void)
 {
+    // Send queued debug output while waiting.
+    serial_debug_poll();
     if (!MODESEGMENT && !CanInterrupt) {
         // Can't enable interrupts (PIC and/or IVT not yet setup)
         cpu_relax();
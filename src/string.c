@@ -13,10 +13,42 @@
  * String ops
  ****************************************************************/
 
+// Sum the bytes in an area a 32-bit word at a time (32bit flat mode).
+static u8
+checksum_flat(void *buf, u32 len)
+{
+    u8 *p = buf;
+    u32 sum = 0;
+    while (len && (u32)p & 3) {
+        sum += *p++;
+        len--;
+    }
+    while (len >= 4) {
+        // Add the bytes of each word into two 16-bit lanes.  A lane
+        // gains at most 0x1fe per word, so fold before it can overflow.
+        u32 words = len / 4, lanes = 0;
+        if (words > 128)
+            words = 128;
+        len -= words * 4;
+        u32 *w = (void*)p;
+        p += words * 4;
+        while (words--) {
+            u32 v = *w++;
+            lanes += (v & 0x00ff00ff) + ((v >> 8) & 0x00ff00ff);
+        }
+        sum += lanes + (lanes >> 16);
+    }
+    while (len--)
+        sum += *p++;
+    return sum;
+}
+
 // Sum the bytes in the specified area.
 u8
 checksum_far(u16 buf_seg, void *buf_far, u32 len)
 {
+    if (!MODESEGMENT)
+        return checksum_flat(MAKE_FLATPTR(buf_seg, buf_far), len);
     SET_SEG(ES, buf_seg);
     u32 i;
     u8 sum = 0;
@@ -59,6 +91,14 @@ memcmp_far(u16 s1seg, const void *s1, u16 s2seg, const void *s2, size_t n)
 int
 memcmp(const void *s1, const void *s2, size_t n)
 {
+    if (!MODESEGMENT)
+        // Skip over matching words - the bytes of the first mismatching
+        // word are then compared below.
+        while (n >= 4 && *(u32*)s1 == *(u32*)s2) {
+            s1 += 4;
+            s2 += 4;
+            n -= 4;
+        }
     while (n) {
         if (*(u8*)s1 != *(u8*)s2)
             return *(u8*)s1 < *(u8*)s2 ? -1 : 1;
@@ -73,6 +113,16 @@ memcmp(const void *s1, const void *s2, size_t n)
 int
 strcmp(const char *s1, const char *s2)
 {
+    if (!MODESEGMENT && !(((u32)s1 | (u32)s2) & 3)) {
+        // Skip over matching words that don't contain the terminator.
+        for (;;) {
+            u32 w = *(u32*)s1;
+            if (w != *(u32*)s2 || ((w - 0x01010101) & ~w & 0x80808080))
+                break;
+            s1 += 4;
+            s2 += 4;
+        }
+    }
     for (;;) {
         if (*s1 != *s2)
             return *s1 < *s2 ? -1 : 1;
@@ -109,6 +159,26 @@ memset16_far(u16 d_seg, void *d_far, u16 c, size_t len)
 void *
 memset(void *s, int c, size_t n)
 {
+    if (!MODESEGMENT) {
+        void *d = s;
+        u32 v = (u8)c * 0x01010101;
+        if (n >= 16) {
+            // Align the destination and fill 4 bytes at a time.
+            u32 head = -(u32)d & 3, words = (n - head) / 4;
+            n -= head + words * 4;
+            asm volatile(
+                "rep stosb (%%edi)\n"
+                "movl %3, %%ecx\n"
+                "rep stosl (%%edi)"
+                : "+c"(head), "+D"(d)
+                : "a"(v), "r"(words) : "cc", "memory");
+        }
+        asm volatile(
+            "rep stosb (%%edi)"
+            : "+c"(n), "+D"(d)
+            : "a"(v) : "cc", "memory");
+        return s;
+    }
     while (n)
         ((char *)s)[--n] = c;
     return s;
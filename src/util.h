@@ -58,6 +58,7 @@ int find_com2en(void);
 
 // bootsplash.c
 void enable_vga_console(void);
+void bootsplash_setup(void);
 void enable_bootsplash(void);
 void disable_bootsplash(void);
 
@@ -136,6 +137,8 @@ void mptable_setup(void);
 
 // fw/mtrr.c
 void mtrr_setup(void);
+void mtrr_wc_setup(u32 addr, u32 size);
+void mtrr_prepboot(void);
 
 // fw/multiboot.c
 void multiboot_init(void);
@@ -237,6 +240,7 @@ struct rom_header;
 void callrom(struct rom_header *rom, u16 bdf);
 void call_bcv(u16 seg, u16 ip);
 int is_pci_vga(struct pci_device *pci);
+void optionrom_prepare(void);
 void optionrom_setup(void);
 void vgarom_setup(void);
 void s3_resume_vga(void);
@@ -255,6 +259,7 @@ u16 get_pnp_offset(void);
 void pnp_init(void);
 
 // post.c
+extern s32 InitRelocDelta;
 void interface_init(void);
 void device_hardware_setup(void);
 void prepareboot(void);
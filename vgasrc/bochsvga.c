@@ -15,6 +15,7 @@
 #include "std/vbe.h" // VBE_CAPABILITY_8BIT_DAC
 #include "stdvga.h" // stdvga_get_linelength
 #include "vgabios.h" // SET_VGA
+#include "vgafb.h" // struct gfx_op
 #include "vgautil.h" // VBE_total_memory
 #include "x86.h" // outw
 
@@ -240,6 +241,38 @@ bochsvga_save_restore(int cmd, u16 seg, void *data)
 }
 
 
+/****************************************************************
+ * Scrolling
+ ****************************************************************/
+
+// Scroll the whole screen up by panning the display start down the
+// virtual screen.  Lines are only copied (to the top of video memory)
+// once the bottom of the virtual screen is reached.
+int
+bochsvga_gfx_op(struct gfx_op *op)
+{
+    struct vgamode_s *vmode_g = op->vmode_g;
+    if (op->op != GO_MEMMOVE || GET_GLOBAL(vmode_g->memmodel) != MM_DIRECT
+        || !bochsvga_dispi_enabled())
+        return -1;
+    u16 height = GET_GLOBAL(vmode_g->height);
+    if (op->x || op->y || op->xlen != GET_GLOBAL(vmode_g->width)
+        || !op->srcy || op->srcy + op->ylen != height
+        || !op->linelength || op->displaystart % op->linelength)
+        return -1;
+    u32 line = op->displaystart / op->linelength + op->srcy;
+    if (line + height <= dispi_read(VBE_DISPI_INDEX_VIRT_HEIGHT)) {
+        dispi_write(VBE_DISPI_INDEX_Y_OFFSET, line);
+        return 0;
+    }
+    // Wrap around - copy the remaining lines to the top of video memory
+    dispi_write(VBE_DISPI_INDEX_Y_OFFSET, 0);
+    op->displaystart = 0;
+    op->srcy = line;
+    return -1;
+}
+
+
 /****************************************************************
  * Mode setting
  ****************************************************************/
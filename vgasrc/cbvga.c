@@ -151,8 +151,11 @@ cbvga_set_mode(struct vgamode_s *vmode_g, int flags)
             op.ylen = GET_GLOBAL(CBmodeinfo.height);
             op.op = GO_MEMSET;
             handle_gfx_op(&op);
+            vgafb_text_shadow_reset(vmode_g, 1);
+            return 0;
         }
     }
+    vgafb_text_shadow_reset(vmode_g, 0);
     return 0;
 }
 
@@ -13,6 +13,7 @@
 #include "stdvga.h" // VGAREG_SEQU_ADDRESS
 #include "string.h" // memset16_far
 #include "vgabios.h" // SET_VGA
+#include "vgafb.h" // struct gfx_op
 #include "vgautil.h" // VBE_total_memory
 
 
@@ -461,6 +462,108 @@ clext_set_mode(struct vgamode_s *vmode_g, int flags)
 }
 
 
+/****************************************************************
+ * BitBLT engine
+ ****************************************************************/
+
+#define CIRRUS_BLTMODE_BACKWARDS        0x01
+#define CIRRUS_BLTMODE_PATTERNCOPY      0x40
+#define CIRRUS_BLTMODE_COLOREXPAND      0x80
+#define CIRRUS_BLTMODEEXT_SOLIDFILL     0x04
+#define CIRRUS_BLT_BUSY                 0x01
+#define CIRRUS_BLT_START                0x02
+#define CIRRUS_ROP_SRC                  0x0d
+#define CIRRUS_BLT_MAXLINES             1024
+
+static void
+cirrus_blt_wait(void)
+{
+    while (stdvga_grdc_read(0x31) & CIRRUS_BLT_BUSY)
+        ;
+}
+
+static void
+cirrus_blt_write3(u8 index, u32 val)
+{
+    stdvga_grdc_write(index, val);
+    stdvga_grdc_write(index + 1, val >> 8);
+    stdvga_grdc_write(index + 2, val >> 16);
+}
+
+// Run a screen to screen blit (or solid fill) of 'height' lines of
+// 'width' bytes.  For backwards blits the addresses are those of the
+// last byte.
+static void
+cirrus_blt(u32 dest, u32 src, int width, int height, int pitch
+           , u8 mode, u8 modeext)
+{
+    stdvga_grdc_write(0x20, width - 1);
+    stdvga_grdc_write(0x21, (width - 1) >> 8);
+    stdvga_grdc_write(0x24, pitch);
+    stdvga_grdc_write(0x25, pitch >> 8);
+    stdvga_grdc_write(0x26, pitch);
+    stdvga_grdc_write(0x27, pitch >> 8);
+    stdvga_grdc_write(0x30, mode);
+    stdvga_grdc_write(0x32, CIRRUS_ROP_SRC);
+    stdvga_grdc_write(0x33, modeext);
+    if (mode & CIRRUS_BLTMODE_BACKWARDS)
+        pitch = -pitch;
+    while (height > 0) {
+        int lines = height > CIRRUS_BLT_MAXLINES ? CIRRUS_BLT_MAXLINES : height;
+        stdvga_grdc_write(0x22, lines - 1);
+        stdvga_grdc_write(0x23, (lines - 1) >> 8);
+        cirrus_blt_write3(0x28, dest);
+        cirrus_blt_write3(0x2c, src);
+        stdvga_grdc_write(0x31, CIRRUS_BLT_START);
+        cirrus_blt_wait();
+        dest += lines * pitch;
+        src += lines * pitch;
+        height -= lines;
+    }
+}
+
+// Handle screen clears and scrolls in linear Cirrus modes with the
+// BitBLT engine instead of going through the framebuffer.
+int
+clext_gfx_op(struct gfx_op *op)
+{
+    struct vgamode_s *vmode_g = op->vmode_g;
+    u8 memmodel = GET_GLOBAL(vmode_g->memmodel);
+    if ((op->op != GO_MEMSET && op->op != GO_MEMMOVE)
+        || (memmodel != MM_PACKED && memmodel != MM_DIRECT)
+        || !is_cirrus_mode(vmode_g) || !op->xlen || !op->ylen)
+        return -1;
+    int bypp = DIV_ROUND_UP(GET_GLOBAL(vmode_g->depth), 8);
+    int pitch = op->linelength, width = op->xlen * bypp;
+    u32 dest = op->displaystart + op->y * pitch + op->x * bypp;
+    u8 mode = (bypp - 1) << 4;
+    cirrus_blt_wait();
+    if (op->op == GO_MEMSET) {
+        // Solid fill uses the foreground color in GR01/GR11/GR13/GR15
+        u32 color = gfx_pixel_color(op);
+        u8 gr01 = stdvga_grdc_read(0x01);
+        stdvga_grdc_write(0x01, color);
+        stdvga_grdc_write(0x11, color >> 8);
+        stdvga_grdc_write(0x13, color >> 16);
+        stdvga_grdc_write(0x15, color >> 24);
+        cirrus_blt(dest, 0, width, op->ylen, pitch
+                   , mode | CIRRUS_BLTMODE_PATTERNCOPY
+                   | CIRRUS_BLTMODE_COLOREXPAND, CIRRUS_BLTMODEEXT_SOLIDFILL);
+        stdvga_grdc_write(0x01, gr01);
+        return 0;
+    }
+    u32 src = op->displaystart + op->srcy * pitch + op->x * bypp;
+    if (src < dest) {
+        u32 last = (op->ylen - 1) * pitch + width - 1;
+        dest += last;
+        src += last;
+        mode |= CIRRUS_BLTMODE_BACKWARDS;
+    }
+    cirrus_blt(dest, src, width, op->ylen, pitch, mode, 0);
+    return 0;
+}
+
+
 /****************************************************************
  * extbios
  ****************************************************************/
@@ -67,30 +67,51 @@ qemu_cfg_write_entry(void *buf, int e, int len)
     qemu_cfg_dma_transfer(buf, len, control);
 }
 
-static int
-qemu_cfg_find_file(const char *filename)
+struct ramfb_files {
+    u16 ramfb;
+    u16 resolution;
+    u32 resolution_size;
+};
+
+// Scan the fw_cfg file directory once for all the files used here.
+// QEMU keeps the directory sorted by name, so the scan stops at the
+// first name after "etc/ramfb-resolution" (which is normally absent).
+static void
+ramfb_find_files(struct ramfb_files *files)
 {
-    u32 count, e, select;
+    u32 count, e;
 
+    memset(files, 0, sizeof(*files));
     qemu_cfg_read_entry(&count, QEMU_CFG_FILE_DIR, sizeof(count));
     count = be32_to_cpu(count);
-    for (select = 0, e = 0; e < count; e++) {
+    for (e = 0; e < count; e++) {
         struct QemuCfgFile qfile;
         qemu_cfg_read(&qfile, sizeof(qfile));
         if (memcmp_far(GET_SEG(SS), qfile.name,
-                       GET_SEG(CS), filename, 10) == 0)
-            select = be16_to_cpu(qfile.select);
+                       GET_SEG(CS), "etc/ramfb", 10) == 0) {
+            files->ramfb = be16_to_cpu(qfile.select);
+            continue;
+        }
+        int cmp = memcmp_far(GET_SEG(SS), qfile.name,
+                             GET_SEG(CS), "etc/ramfb-resolution", 21);
+        if (cmp == 0) {
+            files->resolution = be16_to_cpu(qfile.select);
+            files->resolution_size = be32_to_cpu(qfile.size);
+        }
+        // Only stop early once etc/ramfb was seen, in case the
+        // directory is not sorted (legacy machine types).
+        if (cmp >= 0 && files->ramfb)
+            break;
     }
-    return select;
 }
 
 /* ---------------------------------------------------------------------- */
 
 #define FRAMEBUFFER_WIDTH      1024
 #define FRAMEBUFFER_HEIGHT     768
+#define FRAMEBUFFER_MAX_WIDTH  4096
+#define FRAMEBUFFER_MAX_HEIGHT 2160
 #define FRAMEBUFFER_BPP        4
-#define FRAMEBUFFER_STRIDE     (FRAMEBUFFER_BPP * FRAMEBUFFER_WIDTH)
-#define FRAMEBUFFER_SIZE       (FRAMEBUFFER_STRIDE * FRAMEBUFFER_HEIGHT)
 
 struct QemuRAMFBCfg {
     u64 addr;
@@ -109,15 +130,50 @@ struct QemuRAMFBCfg {
 #define DRM_FORMAT_XRGB8888     fourcc_code('X', 'R', '2', '4') /* [31:0] x:R:G:B 8:8:8:8 little endian */
 
 static u32
-allocate_framebuffer(void)
+allocate_framebuffer(u32 size)
 {
-    u32 res = allocate_pmm(FRAMEBUFFER_SIZE, 1, 1);
+    u32 res = allocate_pmm(size, 1, 1);
     if (!res)
         return 0;
     dprintf(1, "ramfb: framebuffer allocated at %x\n", res);
     return res;
 }
 
+static u32
+parse_decimal(char **pos, char *end)
+{
+    u32 val = 0;
+    while (*pos < end && **pos >= '0' && **pos <= '9')
+        val = val * 10 + *(*pos)++ - '0';
+    return val;
+}
+
+// Read the display size from etc/ramfb-resolution ("<width>x<height>").
+static void
+ramfb_get_resolution(struct ramfb_files *files, u32 *width, u32 *height)
+{
+    char buf[16];
+    u32 len = files->resolution_size;
+    if (!files->resolution || !len)
+        return;
+    if (len > sizeof(buf))
+        len = sizeof(buf);
+    qemu_cfg_read_entry(buf, files->resolution, len);
+    char *pos = buf, *end = buf + len;
+    u32 w = parse_decimal(&pos, end);
+    if (pos >= end || (*pos != 'x' && *pos != 'X'))
+        goto fail;
+    pos++;
+    u32 h = parse_decimal(&pos, end);
+    if (!w || !h || w > FRAMEBUFFER_MAX_WIDTH || h > FRAMEBUFFER_MAX_HEIGHT)
+        goto fail;
+    *width = w;
+    *height = h;
+    return;
+fail:
+    dprintf(1, "ramfb: invalid etc/ramfb-resolution\n");
+}
+
 int
 ramfb_setup(void)
 {
@@ -126,14 +182,20 @@ ramfb_setup(void)
     if (GET_GLOBAL(HaveRunInit))
         return 0;
 
-    u32 select = qemu_cfg_find_file("etc/ramfb");
+    struct ramfb_files files;
+    ramfb_find_files(&files);
+    u32 select = files.ramfb;
     if (select == 0) {
         dprintf(1, "ramfb: fw_cfg (etc/ramfb) file not found\n");
         return -1;
     }
 
     dprintf(1, "ramfb: fw_cfg (etc/ramfb) file at slot 0x%x\n", select);
-    u32 fb = allocate_framebuffer();
+    u32 xlines = FRAMEBUFFER_WIDTH;
+    u32 ylines = FRAMEBUFFER_HEIGHT;
+    ramfb_get_resolution(&files, &xlines, &ylines);
+    u32 linelength = ALIGN(xlines * FRAMEBUFFER_BPP, 64);
+    u32 fb = allocate_framebuffer(linelength * ylines);
     if (!fb) {
         dprintf(1, "ramfb: allocating framebuffer failed\n");
         return -1;
@@ -141,9 +203,6 @@ ramfb_setup(void)
 
     u64 addr = fb;
     u8 bpp = FRAMEBUFFER_BPP * 8;
-    u32 xlines = FRAMEBUFFER_WIDTH;
-    u32 ylines = FRAMEBUFFER_HEIGHT;
-    u32 linelength = FRAMEBUFFER_STRIDE;
     dprintf(1, "Found FB @ %llx %dx%d with %d bpp (%d stride)\n"
             , addr, xlines, ylines, bpp, linelength);
 
@@ -159,9 +218,9 @@ ramfb_setup(void)
         .addr   = cpu_to_be64(fb),
         .fourcc = cpu_to_be32(DRM_FORMAT_XRGB8888),
         .flags  = cpu_to_be32(0),
-        .width  = cpu_to_be32(FRAMEBUFFER_WIDTH),
-        .height = cpu_to_be32(FRAMEBUFFER_HEIGHT),
-        .stride = cpu_to_be32(FRAMEBUFFER_STRIDE),
+        .width  = cpu_to_be32(xlines),
+        .height = cpu_to_be32(ylines),
+        .stride = cpu_to_be32(linelength),
     };
     qemu_cfg_write_entry(&cfg, select, sizeof(cfg));
 
@@ -170,6 +170,37 @@ stdvga_dac_read(u16 seg, u8 *data_far, u8 start, int count)
     }
 }
 
+// Read palette entries in VBE format (blue, green, red, alignment)
+void
+stdvga_dac_read_vbe(u16 seg, u8 *data_far, u8 start, int count)
+{
+    outb(start, VGAREG_DAC_READ_ADDRESS);
+    for (; count; count--, data_far += 4) {
+        SET_FARVAR(seg, data_far[2], inb(VGAREG_DAC_DATA));
+        SET_FARVAR(seg, data_far[1], inb(VGAREG_DAC_DATA));
+        SET_FARVAR(seg, data_far[0], inb(VGAREG_DAC_DATA));
+        SET_FARVAR(seg, data_far[3], 0);
+    }
+}
+
+void
+stdvga_dac_write_vbe(u16 seg, u8 *data_far, u8 start, int count)
+{
+    outb(start, VGAREG_DAC_WRITE_ADDRESS);
+    for (; count; count--, data_far += 4) {
+        outb(GET_FARVAR(seg, data_far[2]), VGAREG_DAC_DATA);
+        outb(GET_FARVAR(seg, data_far[1]), VGAREG_DAC_DATA);
+        outb(GET_FARVAR(seg, data_far[0]), VGAREG_DAC_DATA);
+    }
+}
+
+void
+stdvga_wait_retrace(void)
+{
+    while (!(inb(VGAREG_ACTL_RESET) & 0x08))
+        ;
+}
+
 void
 stdvga_dac_write(u16 seg, u8 *data_far, u8 start, int count)
 {
@@ -374,11 +374,45 @@ fail:
     regs->ax = 0x014f;
 }
 
+static void
+vbe_104f09(struct bregs *regs)
+{
+    if (!CONFIG_VGA_STDVGA_PORTS || regs->dx + regs->cx > 256)
+        goto fail;
+    u8 *data_far = (void*)(regs->di + 0);
+    switch (regs->bl) {
+    case 0x80:
+        stdvga_wait_retrace();
+        // fall through
+    case 0x00:
+        stdvga_dac_write_vbe(regs->es, data_far, regs->dx, regs->cx);
+        break;
+    case 0x01:
+        stdvga_dac_read_vbe(regs->es, data_far, regs->dx, regs->cx);
+        break;
+    default:
+        goto fail;
+    }
+    regs->ax = 0x004f;
+    return;
+fail:
+    regs->ax = 0x014f;
+}
+
 static void
 vbe_104f0a(struct bregs *regs)
 {
-    debug_stub(regs);
-    regs->ax = 0x0100;
+    if (!CONFIG_VGA_BOCHS || regs->bl != 0x00) {
+        debug_stub(regs);
+        regs->ax = 0x0100;
+        return;
+    }
+    // Protected mode interface table and code (see vgaentry.S)
+    extern u8 vbe_pm_start[], vbe_pm_end[];
+    regs->es = get_global_seg();
+    regs->di = (u32)vbe_pm_start;
+    regs->cx = vbe_pm_end - vbe_pm_start;
+    regs->ax = 0x004f;
 }
 
 static void
@@ -454,6 +488,7 @@ handle_104f(struct bregs *regs)
     case 0x06: vbe_104f06(regs); break;
     case 0x07: vbe_104f07(regs); break;
     case 0x08: vbe_104f08(regs); break;
+    case 0x09: vbe_104f09(regs); break;
     case 0x0a: vbe_104f0a(regs); break;
     case 0x10: vbe_104f10(regs); break;
     case 0x15: vbe_104f15(regs); break;
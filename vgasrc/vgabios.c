@@ -167,6 +167,21 @@ write_char(struct cursorpos *pcp, struct carattr ca)
     }
 }
 
+// Scroll the screen if the cursor has moved past the last line.
+static void
+teletype_scroll(struct cursorpos *pcp)
+{
+    u16 nbrows = GET_BDA(video_rows);
+    if (pcp->y > nbrows) {
+        pcp->y--;
+
+        struct cursorpos win = {0, 0, pcp->page};
+        struct cursorpos winsize = {GET_BDA(video_cols), nbrows+1};
+        struct carattr attr = {' ', 0, 0};
+        vgafb_scroll(win, winsize, 1, attr);
+    }
+}
+
 // Write a character to the screen at a given position.  Implement
 // special characters and scroll the screen if necessary.
 static void
@@ -190,17 +205,7 @@ write_teletype(struct cursorpos *pcp, struct carattr ca)
         write_char(pcp, ca);
         break;
     }
-
-    // Do we need to scroll ?
-    u16 nbrows = GET_BDA(video_rows);
-    if (pcp->y > nbrows) {
-        pcp->y--;
-
-        struct cursorpos win = {0, 0, pcp->page};
-        struct cursorpos winsize = {GET_BDA(video_cols), nbrows+1};
-        struct carattr attr = {' ', 0, 0};
-        vgafb_scroll(win, winsize, 1, attr);
-    }
+    teletype_scroll(pcp);
 }
 
 
@@ -433,24 +438,34 @@ handle_1008(struct bregs *regs)
     regs->ah = ca.attr;
 }
 
+// Write a character 'count' times, a row at a time.
+static void
+write_chars(struct cursorpos cp, struct carattr ca, int count)
+{
+    u16 cols = GET_BDA(video_cols);
+    while (count > 0 && cp.x < cols) {
+        int n = cols - cp.x;
+        if (n > count)
+            n = count;
+        vgafb_write_chars(cp, ca, n);
+        count -= n;
+        cp.x = 0;
+        cp.y++;
+    }
+}
+
 static void noinline
 handle_1009(struct bregs *regs)
 {
     struct carattr ca = {regs->al, regs->bl, 1};
-    struct cursorpos cp = get_cursor_pos(regs->bh);
-    int count = regs->cx;
-    while (count--)
-        write_char(&cp, ca);
+    write_chars(get_cursor_pos(regs->bh), ca, regs->cx);
 }
 
 static void noinline
 handle_100a(struct bregs *regs)
 {
     struct carattr ca = {regs->al, regs->bl, 0};
-    struct cursorpos cp = get_cursor_pos(regs->bh);
-    int count = regs->cx;
-    while (count--)
-        write_char(&cp, ca);
+    write_chars(get_cursor_pos(regs->bh), ca, regs->cx);
 }
 
 
@@ -986,14 +1001,35 @@ handle_1013(struct bregs *regs)
     u16 count = regs->cx;
     u8 *offset_far = (void*)(regs->bp + 0);
     u8 attr = regs->bl;
-    while (count--) {
-        u8 car = GET_FARVAR(regs->es, *offset_far);
-        offset_far++;
-        if (regs->al & 2) {
-            attr = GET_FARVAR(regs->es, *offset_far);
-            offset_far++;
+    int pairs = regs->al & 2, step = pairs ? 2 : 1;
+    u16 cols = GET_BDA(video_cols);
+    while (count) {
+        // Write the printable characters that fit on this line at once
+        int n = 0;
+        while (n < count && cp.x + n < cols) {
+            u8 car = GET_FARVAR(regs->es, offset_far[n * step]);
+            if (car == 7 || car == 8 || car == '\r' || car == '\n')
+                break;
+            n++;
+        }
+        if (n) {
+            vgafb_write_string(cp, attr, regs->es, offset_far, n, pairs);
+            offset_far += n * step;
+            count -= n;
+            cp.x += n;
+            if (cp.x == cols) {
+                cp.x = 0;
+                cp.y++;
+            }
+            teletype_scroll(&cp);
+            continue;
         }
 
+        u8 car = GET_FARVAR(regs->es, *offset_far);
+        if (pairs)
+            attr = GET_FARVAR(regs->es, offset_far[1]);
+        offset_far += step;
+        count--;
         struct carattr ca = {car, attr, 1};
         write_teletype(&cp, ca);
     }
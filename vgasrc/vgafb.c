@@ -14,6 +14,7 @@
 #include "vgafb.h" // vgafb_write_char
 #include "vgahw.h" // vgahw_get_linelength
 #include "vgautil.h" // VBE_framebuffer
+#include "x86.h" // lgdt
 
 static inline void
 memmove_stride(u16 seg, void *dst, void *src, int copylen, int stride, int lines)
@@ -46,6 +47,29 @@ memset16_stride(u16 seg, void *dst, u16 val, int setlen, int stride, int lines)
  * Basic stdvga graphic manipulation
  ****************************************************************/
 
+// Write 'color' to all planes on every write (set/reset)
+static void
+planar_set_reset(u8 color)
+{
+    stdvga_grdc_write(0x00, color);
+    stdvga_grdc_write(0x01, 0x0f);
+}
+
+static void
+planar_write_mode(u8 mode)
+{
+    stdvga_grdc_write(0x05, (stdvga_grdc_read(0x05) & ~0x03) | mode);
+}
+
+// Return to write mode 0 without set/reset
+static void
+planar_restore(void)
+{
+    stdvga_grdc_write(0x01, 0x00);
+    stdvga_grdc_write(0x00, 0x00);
+    planar_write_mode(0);
+}
+
 static void
 gfx_planar(struct gfx_op *op)
 {
@@ -76,21 +100,41 @@ gfx_planar(struct gfx_op *op)
         }
         break;
     case GO_MEMSET:
-        for (plane = 0; plane < 4; plane++) {
-            stdvga_planar4_plane(plane);
-            u8 data = (op->pixels[0] & (1<<plane)) ? 0xff : 0x00;
-            memset_stride(SEG_GRAPH, dest_far, data
-                          , op->xlen / 8, op->linelength, op->ylen);
-        }
-        break;
+        // Fill all four planes in one pass using set/reset
+        stdvga_planar4_plane(-1);
+        planar_set_reset(op->pixels[0]);
+        memset_stride(SEG_GRAPH, dest_far, 0xff
+                      , op->xlen / 8, op->linelength, op->ylen);
+        planar_restore();
+        return;
     case GO_MEMMOVE: ;
+        // Copy all four planes in one pass through the latches
         void *src_far = (void*)(op->srcy * op->linelength + op->x / 8);
-        for (plane = 0; plane < 4; plane++) {
-            stdvga_planar4_plane(plane);
-            memmove_stride(SEG_GRAPH, dest_far, src_far
-                           , op->xlen / 8, op->linelength, op->ylen);
+        stdvga_planar4_plane(-1);
+        planar_write_mode(1);
+        memmove_stride(SEG_GRAPH, dest_far, src_far
+                       , op->xlen / 8, op->linelength, op->ylen);
+        planar_restore();
+        return;
+    case GO_GLYPH: ;
+        // Fill the cells with the background color, then load the
+        // latches with it and draw each scan line of the run with
+        // write mode 3 (set bits take the foreground color).
+        stdvga_planar4_plane(-1);
+        planar_set_reset(op->pixels[1]);
+        memset_stride(SEG_GRAPH, dest_far, 0xff
+                      , op->xlen / 8, op->linelength, op->ylen);
+        u8 latch = GET_FARVAR(SEG_GRAPH, *(u8*)dest_far);
+        asm volatile("" : : "q"(latch));
+        stdvga_grdc_write(0x00, op->pixels[0]);
+        planar_write_mode(3);
+        int y;
+        for (y = 0; y < op->ylen; y++, dest_far += op->linelength) {
+            u8 fontline = GET_FARVAR(op->font.seg, *(u8*)(op->font.offset+y));
+            memset_far(SEG_GRAPH, dest_far, fontline, op->xlen / 8);
         }
-        break;
+        planar_restore();
+        return;
     }
     stdvga_planar4_plane(-1);
 }
@@ -154,6 +198,30 @@ gfx_cga(struct gfx_op *op)
         memmove_stride(SEG_CTEXT, dest_far + 0x2000, src_far + 0x2000
                        , op->xlen / 8 * bpp, op->linelength, op->ylen / 2);
         break;
+    case GO_GLYPH: ;
+        // Each scan line of the run repeats the same byte (or word)
+        int y;
+        for (y = op->y; y < op->y + op->ylen; y++) {
+            u8 fontline = GET_FARVAR(op->font.seg
+                                     , *(u8*)(op->font.offset + y - op->y));
+            void *line_far = (void*)(y / 2 * op->linelength + op->x / 8 * bpp
+                                     + (y & 1 ? 0x2000 : 0));
+            int pixel;
+            if (bpp == 1) {
+                u8 fg = op->pixels[0] & 1 ? 0xff : 0x00;
+                u8 bg = op->pixels[1] & 1 ? 0xff : 0x00;
+                memset_far(SEG_CTEXT, line_far, (fontline & fg) | (~fontline & bg)
+                           , op->xlen / 8);
+            } else {
+                u16 data = 0;
+                for (pixel=0; pixel<8; pixel++)
+                    data |= ((fontline & (0x80>>pixel) ? op->pixels[0]
+                              : op->pixels[1]) & 3) << ((7-pixel) * 2);
+                memset16_far(SEG_CTEXT, line_far, cpu_to_be16(data)
+                             , op->xlen / 8 * 2);
+            }
+        }
+        break;
     }
 }
 
@@ -178,6 +246,23 @@ gfx_packed(struct gfx_op *op)
         memmove_stride(SEG_GRAPH, dest_far, src_far
                        , op->xlen, op->linelength, op->ylen);
         break;
+    case GO_GLYPH: ;
+        // Build each scan line of the run once and copy it in chunks
+        u8 data[64];
+        int y, i, len, remain;
+        for (y = 0; y < op->ylen; y++, dest_far += op->linelength) {
+            u8 fontline = GET_FARVAR(op->font.seg, *(u8*)(op->font.offset+y));
+            len = op->xlen < sizeof(data) ? op->xlen : sizeof(data);
+            for (i=0; i<len; i++)
+                data[i] = op->pixels[(fontline & (0x80>>(i&7))) ? 0 : 1];
+            void *d = dest_far;
+            for (remain = op->xlen; remain > 0; remain -= len, d += len) {
+                if (len > remain)
+                    len = remain;
+                memcpy_far(SEG_GRAPH, d, GET_SEG(SS), data, len);
+            }
+        }
+        break;
     }
 }
 
@@ -210,8 +295,83 @@ void memcpy_high(void *dest, void *src, u32 len)
         : : "cc", "memory");
 }
 
+struct flat_state {
+    struct descloc_s gdt;
+    u32 flags;
+    u8 a20;
+};
+
+// Give %es a 4GiB limit ("big real mode") so that the framebuffer can
+// be accessed with 32bit addresses for the rest of a graphics
+// operation.  This is only done for legacy callers (extra stack in
+// use) that are running in real mode - otherwise int 1587 is used.
+static int
+flat_enter(struct flat_state *fs)
+{
+    if (!CONFIG_VGA_FLAT_FRAMEBUFFER
+        || !(GET_BDA_EXT(flags) & BF_EXTRA_STACK))
+        return 0;
+    u16 msw;
+    asm volatile("smsw %0" : "=r"(msw));
+    if (msw & CR0_PE)
+        // vm86 mode
+        return 0;
+    // Interrupts stay off until flat_exit() so that nothing can reset
+    // the segment limit while it is in use (int 1587 does the same).
+    fs->flags = save_flags();
+    irq_disable();
+    sgdt(&fs->gdt);
+    fs->a20 = set_a20(1);
+    u64 gdt[2] = { 0, GDT_DATA | GDT_GRANLIMIT(0xffffffff) };
+    struct descloc_s desc = {
+        sizeof(gdt) - 1, (u32)MAKE_FLATPTR(GET_SEG(SS), gdt) };
+    lgdt(&desc);
+    u32 cr0;
+    asm volatile(
+        "movl %%cr0, %0\n"
+        "orb $1, %b0\n"
+        "movl %0, %%cr0\n"
+        "movw %w1, %%es\n"
+        "andb $0xfe, %b0\n"
+        "movl %0, %%cr0\n"
+        : "=&q"(cr0) : "r"(1<<3) : "memory");
+    return 1;
+}
+
+static void
+flat_exit(struct flat_state *fs)
+{
+    lgdt(&fs->gdt);
+    set_a20(fs->a20);
+    restore_flags(fs->flags);
+}
+
+// Copy between two linear addresses while in big real mode.
+static void
+memcpy_flat(void *dest, void *src, u32 len)
+{
+    u32 count = len / 4;
+    asm volatile(
+        "movw %w4, %%es\n"
+        "rep movsl %%es:(%%esi), %%es:(%%edi)\n"
+        "movl %3, %%ecx\n"
+        "rep movsb %%es:(%%esi), %%es:(%%edi)\n"
+        : "+S"(src), "+D"(dest), "+c"(count)
+        : "r"(len & 3), "r"(0) : "cc", "memory");
+}
+
+static void
+fb_copy(int flat, void *dest, void *src, u32 len)
+{
+    if (flat)
+        memcpy_flat(dest, src, len);
+    else
+        memcpy_high(dest, src, len);
+}
+
 static void
-memmove_stride_high(void *dst, void *src, int copylen, int stride, int lines)
+memmove_stride_high(int flat, void *dst, void *src, int copylen, int stride
+                    , int lines)
 {
     if (src < dst) {
         dst += stride * (lines - 1);
@@ -219,12 +379,12 @@ memmove_stride_high(void *dst, void *src, int copylen, int stride, int lines)
         stride = -stride;
     }
     for (; lines; lines--, dst+=stride, src+=stride)
-        memcpy_high(dst, src, copylen);
+        fb_copy(flat, dst, src, copylen);
 }
 
 // Map a CGA color to a "direct" mode rgb value.
 static u32
-get_color(int depth, u8 attr)
+calc_color(int depth, u8 attr)
 {
     int rbits, gbits, bbits;
     switch (depth) {
@@ -245,7 +405,7 @@ get_color(int depth, u8 attr)
 
 // Find the closest attribute for a given framebuffer color
 static u8
-reverse_color(int depth, u32 color)
+calc_reverse_color(int depth, u32 color)
 {
     int rbits, gbits, bbits;
     switch (depth) {
@@ -264,6 +424,54 @@ reverse_color(int depth, u32 color)
     return (h ? 8 : 0) | ((r-h) ? 4 : 0) | ((g-h) ? 2 : 0) | ((b-h) ? 1 : 0);
 }
 
+// Precomputed CGA color to rgb values for 15, 16, and 24 bit depths.
+static u32 DirectColors[3][16] VAR16;
+
+static inline int
+direct_colors_index(int depth)
+{
+    return depth == 15 ? 0 : (depth == 16 ? 1 : 2);
+}
+
+void
+vgafb_init_colors(void)
+{
+    int i, attr;
+    for (i = 0; i < ARRAY_SIZE(DirectColors); i++) {
+        int depth = i == 0 ? 15 : (i == 1 ? 16 : 24);
+        for (attr = 0; attr < 16; attr++)
+            SET_VGA(DirectColors[i][attr], calc_color(depth, attr));
+    }
+}
+
+static u32
+get_color(int depth, u8 attr)
+{
+    return GET_GLOBAL(DirectColors[direct_colors_index(depth)][attr & 0x0f]);
+}
+
+static u8
+reverse_color(int depth, u32 color)
+{
+    // Pixels drawn by the BIOS match one of the table entries exactly
+    int idx = direct_colors_index(depth);
+    color &= (1 << (depth > 16 ? 24 : depth)) - 1;
+    int attr;
+    for (attr = 0; attr < 16; attr++)
+        if (GET_GLOBAL(DirectColors[idx][attr]) == color)
+            return attr;
+    return calc_reverse_color(depth, color);
+}
+
+// Return the framebuffer value of the color in op->pixels[0].
+u32
+gfx_pixel_color(struct gfx_op *op)
+{
+    if (GET_GLOBAL(op->vmode_g->memmodel) != MM_DIRECT)
+        return op->pixels[0];
+    return get_color(GET_GLOBAL(op->vmode_g->depth), op->pixels[0]);
+}
+
 static void
 gfx_direct(struct gfx_op *op)
 {
@@ -274,37 +482,77 @@ gfx_direct(struct gfx_op *op)
     int bypp = DIV_ROUND_UP(depth, 8);
     void *dest_far = (fb + op->displaystart + op->y * op->linelength
                       + op->x * bypp);
+    void *data_far;
     u8 data[64];
-    int i;
+    int maxpix = (sizeof(data) - 4) / bypp;
+    int i, y, len, remain;
+    struct flat_state fs;
+    int flat = flat_enter(&fs);
     switch (op->op) {
     default:
     case GO_READ8:
-        memcpy_high(MAKE_FLATPTR(GET_SEG(SS), data), dest_far, bypp * 8);
+        fb_copy(flat, MAKE_FLATPTR(GET_SEG(SS), data), dest_far, bypp * 8);
         for (i=0; i<8; i++)
             op->pixels[i] = reverse_color(depth, *(u32*)&data[i*bypp]);
         break;
     case GO_WRITE8:
         for (i=0; i<8; i++)
             *(u32*)&data[i*bypp] = get_color(depth, op->pixels[i]);
-        memcpy_high(dest_far, MAKE_FLATPTR(GET_SEG(SS), data), bypp * 8);
+        fb_copy(flat, dest_far, MAKE_FLATPTR(GET_SEG(SS), data), bypp * 8);
         break;
     case GO_MEMSET: ;
         u32 color = get_color(depth, op->pixels[0]);
-        for (i=0; i<8; i++)
+        if (!flat) {
+            for (i=0; i<8; i++)
+                *(u32*)&data[i*bypp] = color;
+            memcpy_high(dest_far, MAKE_FLATPTR(GET_SEG(SS), data), bypp * 8);
+            memcpy_high(dest_far + bypp * 8, dest_far
+                        , op->xlen * bypp - bypp * 8);
+            for (i=1; i < op->ylen; i++)
+                memcpy_high(dest_far + op->linelength * i
+                            , dest_far, op->xlen * bypp);
+            break;
+        }
+        // Fill from the stack so the framebuffer is never read back.
+        for (i=0; i<maxpix; i++)
             *(u32*)&data[i*bypp] = color;
-        memcpy_high(dest_far, MAKE_FLATPTR(GET_SEG(SS), data), bypp * 8);
-        memcpy_high(dest_far + bypp * 8, dest_far, op->xlen * bypp - bypp * 8);
-        for (i=1; i < op->ylen; i++)
-            memcpy_high(dest_far + op->linelength * i
-                        , dest_far, op->xlen * bypp);
+        data_far = MAKE_FLATPTR(GET_SEG(SS), data);
+        for (y = 0; y < op->ylen; y++, dest_far += op->linelength) {
+            void *d = dest_far;
+            for (remain = op->xlen; remain > 0; remain -= len, d += len*bypp) {
+                len = remain < maxpix ? remain : maxpix;
+                memcpy_flat(d, data_far, len * bypp);
+            }
+        }
         break;
     case GO_MEMMOVE: ;
         void *src_far = (fb + op->displaystart + op->srcy * op->linelength
                          + op->x * bypp);
-        memmove_stride_high(dest_far, src_far
+        memmove_stride_high(flat, dest_far, src_far
                             , op->xlen * bypp, op->linelength, op->ylen);
         break;
+    case GO_GLYPH: ;
+        // Render xlen/8 copies of a glyph, converting the two colors
+        // once and copying as many cells per scanline as fit in 'data'.
+        u32 fg = get_color(depth, op->pixels[0]);
+        u32 bg = get_color(depth, op->pixels[1]);
+        data_far = MAKE_FLATPTR(GET_SEG(SS), data);
+        for (y = 0; y < op->ylen; y++, dest_far += op->linelength) {
+            u8 fontline = GET_FARVAR(op->font.seg, *(u8*)(op->font.offset+y));
+            len = op->xlen < maxpix ? op->xlen : ALIGN_DOWN(maxpix, 8);
+            for (i=0; i<len; i++)
+                *(u32*)&data[i*bypp] = (fontline & (0x80>>(i&7))) ? fg : bg;
+            void *d = dest_far;
+            for (remain = op->xlen; remain > 0; remain -= len, d += len*bypp) {
+                if (len > remain)
+                    len = remain;
+                fb_copy(flat, d, data_far, len * bypp);
+            }
+        }
+        break;
     }
+    if (flat)
+        flat_exit(&fs);
 }
 
 
@@ -326,6 +574,8 @@ init_gfx_op(struct gfx_op *op, struct vgamode_s *vmode_g)
 void
 handle_gfx_op(struct gfx_op *op)
 {
+    if (vgahw_gfx_op(op) == 0)
+        return;
     switch (GET_GLOBAL(op->vmode_g->memmodel)) {
     case MM_PLANAR:
         gfx_planar(op);
@@ -344,6 +594,69 @@ handle_gfx_op(struct gfx_op *op)
     }
 }
 
+
+
+/****************************************************************
+ * Emulated text mode character shadow
+ ****************************************************************/
+
+// When emulating text mode on a framebuffer, a copy of the
+// character/attribute cells is kept in TextShadowSeg, so that reads
+// and scrolls don't need to read back from the (slow, uncached)
+// framebuffer.  It is only valid while BF_TEXT_SHADOW is set.
+
+static int
+text_shadow_active(void)
+{
+    return CONFIG_VGA_EMULATE_TEXT && GET_BDA_EXT(flags) & BF_TEXT_SHADOW;
+}
+
+static u16 *
+text_shadow_cell(struct cursorpos cp)
+{
+    return (void*)((cp.y * GET_BDA(video_cols) + cp.x) * 2);
+}
+
+// Compare 'count' cells of two rows of the shadow
+static int
+text_shadow_cmp(struct cursorpos cp1, struct cursorpos cp2, int count)
+{
+    u16 seg = GET_GLOBAL(TextShadowSeg);
+    return memcmp_far(seg, text_shadow_cell(cp1), seg, text_shadow_cell(cp2)
+                      , count * 2);
+}
+
+// Check if 'count' cells at 'cp' all contain 'val'
+static int
+text_shadow_match(struct cursorpos cp, u16 val, int count)
+{
+    u16 seg = GET_GLOBAL(TextShadowSeg);
+    u16 *cell = text_shadow_cell(cp);
+    for (; count; count--, cell++)
+        if (GET_FARVAR(seg, *cell) != val)
+            return 0;
+    return 1;
+}
+
+// Reset the shadow after a mode set.  The shadow is enabled only if
+// the framebuffer was cleared for an emulated text mode.
+void
+vgafb_text_shadow_reset(struct vgamode_s *vmode_g, int cleared)
+{
+    if (!CONFIG_VGA_EMULATE_TEXT)
+        return;
+    MASK_BDA_EXT(flags, BF_TEXT_SHADOW, 0);
+    u16 seg = GET_GLOBAL(TextShadowSeg);
+    if (!seg || !cleared || !vga_emulate_text())
+        return;
+    u32 cells = ((GET_GLOBAL(vmode_g->width) / GET_GLOBAL(vmode_g->cwidth))
+                 * (GET_GLOBAL(vmode_g->height) / GET_GLOBAL(vmode_g->cheight)));
+    if (cells > GET_GLOBAL(TextShadowCells))
+        return;
+    memset16_far(seg, 0, 0x0720, cells * 2);
+    MASK_BDA_EXT(flags, 0, BF_TEXT_SHADOW);
+}
+
 // Move characters when in graphics mode.
 static void
 gfx_move_chars(struct vgamode_s *vmode_g, struct cursorpos dest
@@ -358,7 +671,29 @@ gfx_move_chars(struct vgamode_s *vmode_g, struct cursorpos dest
     op.ylen = movesize.y * cheight;
     op.srcy = op.y + lines * cheight;
     op.op = GO_MEMMOVE;
-    handle_gfx_op(&op);
+    if (!text_shadow_active()) {
+        handle_gfx_op(&op);
+        return;
+    }
+
+    // Only move the rows whose contents actually change
+    op.ylen = cheight;
+    int i, step = lines > 0 ? 1 : -1;
+    u16 seg = GET_GLOBAL(TextShadowSeg);
+    struct cursorpos d = dest;
+    if (step < 0)
+        d.y += movesize.y - 1;
+    for (i = 0; i < movesize.y; i++, d.y += step) {
+        struct cursorpos src = d;
+        src.y += lines;
+        if (!text_shadow_cmp(d, src, movesize.x))
+            continue;
+        op.y = d.y * cheight;
+        op.srcy = src.y * cheight;
+        handle_gfx_op(&op);
+        memcpy_far(seg, text_shadow_cell(d), seg, text_shadow_cell(src)
+                   , movesize.x * 2);
+    }
 }
 
 // Clear area of screen in graphics mode.
@@ -377,7 +712,23 @@ gfx_clear_chars(struct vgamode_s *vmode_g, struct cursorpos win
     if (vga_emulate_text())
         op.pixels[0] = ca.attr >> 4;
     op.op = GO_MEMSET;
-    handle_gfx_op(&op);
+    if (!text_shadow_active()) {
+        handle_gfx_op(&op);
+        return;
+    }
+
+    // Only clear the rows that aren't already blank
+    u16 blank = ((ca.use_attr ? ca.attr : 0x07) << 8) | ca.car;
+    u16 seg = GET_GLOBAL(TextShadowSeg);
+    op.ylen = cheight;
+    int i;
+    for (i = 0; i < winsize.y; i++, win.y++) {
+        if (text_shadow_match(win, blank, winsize.x))
+            continue;
+        op.y = win.y * cheight;
+        handle_gfx_op(&op);
+        memset16_far(seg, text_shadow_cell(win), blank, winsize.x * 2);
+    }
 }
 
 // Return the font for a given character
@@ -396,14 +747,11 @@ get_font_data(u8 c)
     return font;
 }
 
-// Write a character to the screen in graphics mode.
+// Write 'count' copies of a character, all drawn with the same colors.
 static void
-gfx_write_char(struct vgamode_s *vmode_g
-                , struct cursorpos cp, struct carattr ca)
+gfx_write_run(struct vgamode_s *vmode_g
+              , struct cursorpos cp, struct carattr ca, int count)
 {
-    if (cp.x >= GET_BDA(video_cols))
-        return;
-
     struct segoff_s font = get_font_data(ca.car);
     struct gfx_op op;
     init_gfx_op(&op, vmode_g);
@@ -412,7 +760,19 @@ gfx_write_char(struct vgamode_s *vmode_g
     op.y = cp.y * cheight;
     u8 fgattr = ca.attr, bgattr = 0x00;
     int usexor = 0;
-    if (vga_emulate_text()) {
+    if (text_shadow_active()) {
+        // Keep the attribute on screen unless a new one is given
+        u16 seg = GET_GLOBAL(TextShadowSeg);
+        u16 *cell = text_shadow_cell(cp);
+        if (!ca.use_attr)
+            fgattr = GET_FARVAR(seg, *cell) >> 8;
+        u16 val = ca.car | (fgattr << 8);
+        if (text_shadow_match(cp, val, count))
+            return;
+        memset16_far(seg, cell, val, count * 2);
+        bgattr = fgattr >> 4;
+        fgattr = fgattr & 0x0f;
+    } else if (vga_emulate_text()) {
         if (ca.use_attr) {
             bgattr = fgattr >> 4;
             fgattr = fgattr & 0x0f;
@@ -429,22 +789,78 @@ gfx_write_char(struct vgamode_s *vmode_g
         usexor = 1;
         fgattr &= 0x7f;
     }
-    int i;
-    for (i = 0; i < cheight; i++, op.y++) {
-        u8 fontline = GET_FARVAR(font.seg, *(u8*)(font.offset+i));
-        if (usexor) {
-            op.op = GO_READ8;
+
+    if (!usexor) {
+        // Render the whole run of glyphs in one operation
+        op.op = GO_GLYPH;
+        op.font = font;
+        op.xlen = count * 8;
+        op.ylen = cheight;
+        op.pixels[0] = fgattr;
+        op.pixels[1] = bgattr;
+        handle_gfx_op(&op);
+        return;
+    }
+
+    for (; count; count--, op.x += 8) {
+        int i;
+        for (i = 0; i < cheight; i++, op.y++) {
+            u8 fontline = GET_FARVAR(font.seg, *(u8*)(font.offset+i));
+            if (usexor) {
+                op.op = GO_READ8;
+                handle_gfx_op(&op);
+                int j;
+                for (j = 0; j < 8; j++)
+                    op.pixels[j] ^= (fontline & (0x80>>j)) ? fgattr : 0x00;
+            } else {
+                int j;
+                for (j = 0; j < 8; j++)
+                    op.pixels[j] = (fontline & (0x80>>j)) ? fgattr : bgattr;
+            }
+            op.op = GO_WRITE8;
             handle_gfx_op(&op);
-            int j;
-            for (j = 0; j < 8; j++)
-                op.pixels[j] ^= (fontline & (0x80>>j)) ? fgattr : 0x00;
-        } else {
-            int j;
-            for (j = 0; j < 8; j++)
-                op.pixels[j] = (fontline & (0x80>>j)) ? fgattr : bgattr;
         }
-        op.op = GO_WRITE8;
-        handle_gfx_op(&op);
+        op.y -= cheight;
+    }
+}
+
+// Return how many of the 'count' cells at 'cp' share the colors of the
+// first one.  Without a new attribute each cell keeps its own.
+static int
+gfx_attr_run(struct cursorpos cp, struct carattr ca, int count)
+{
+    if (ca.use_attr)
+        return count;
+    if (text_shadow_active()) {
+        u16 seg = GET_GLOBAL(TextShadowSeg);
+        u16 *cell = text_shadow_cell(cp);
+        u8 attr = GET_FARVAR(seg, *cell) >> 8;
+        int n = 1;
+        while (n < count && GET_FARVAR(seg, cell[n]) >> 8 == attr)
+            n++;
+        return n;
+    }
+    if (vga_emulate_text())
+        // The background is guessed from each cell's pixels
+        return 1;
+    return count;
+}
+
+// Write 'count' copies of a character to the screen in graphics mode.
+static void
+gfx_write_char(struct vgamode_s *vmode_g
+                , struct cursorpos cp, struct carattr ca, int count)
+{
+    if (cp.x >= GET_BDA(video_cols))
+        return;
+    if (cp.x + count > GET_BDA(video_cols))
+        count = GET_BDA(video_cols) - cp.x;
+
+    while (count > 0) {
+        int n = gfx_attr_run(cp, ca, count);
+        gfx_write_run(vmode_g, cp, ca, n);
+        cp.x += n;
+        count -= n;
     }
 }
 
@@ -457,6 +873,11 @@ gfx_read_char(struct vgamode_s *vmode_g, struct cursorpos cp)
     if (cp.x >= GET_BDA(video_cols) || cheight > ARRAY_SIZE(lines))
         goto fail;
 
+    if (text_shadow_active()) {
+        u16 v = GET_FARVAR(GET_GLOBAL(TextShadowSeg), *text_shadow_cell(cp));
+        return (struct carattr){v, v>>8, 0};
+    }
+
     // Read cell from screen
     struct gfx_op op;
     init_gfx_op(&op, vmode_g);
@@ -506,6 +927,10 @@ vgafb_write_pixel(u8 color, u16 x, u16 y)
     if (!vmode_g)
         return;
 
+    // Pixel writes make the character shadow stale
+    if (text_shadow_active())
+        MASK_BDA_EXT(flags, BF_TEXT_SHADOW, 0);
+
     struct gfx_op op;
     init_gfx_op(&op, vmode_g);
     op.x = ALIGN_DOWN(x, 8);
@@ -630,7 +1055,7 @@ vgafb_write_char(struct cursorpos cp, struct carattr ca)
         return;
 
     if (GET_GLOBAL(vmode_g->memmodel) != MM_TEXT) {
-        gfx_write_char(vmode_g, cp, ca);
+        gfx_write_char(vmode_g, cp, ca, 1);
         return;
     }
 
@@ -643,6 +1068,65 @@ vgafb_write_char(struct cursorpos cp, struct carattr ca)
     }
 }
 
+// Write 'count' copies of a character on one row of the screen.
+void
+vgafb_write_chars(struct cursorpos cp, struct carattr ca, int count)
+{
+    struct vgamode_s *vmode_g = get_current_mode();
+    if (!vmode_g)
+        return;
+
+    if (GET_GLOBAL(vmode_g->memmodel) != MM_TEXT) {
+        gfx_write_char(vmode_g, cp, ca, count);
+        return;
+    }
+
+    for (; count; count--, cp.x++)
+        vgafb_write_char(cp, ca);
+}
+
+// Write 'count' characters (or character/attribute pairs) from
+// seg:str to a single line of the screen.
+void
+vgafb_write_string(struct cursorpos cp, u8 attr, u16 seg, u8 *str
+                   , int count, int pairs)
+{
+    struct vgamode_s *vmode_g = get_current_mode();
+    if (!vmode_g)
+        return;
+
+    if (GET_GLOBAL(vmode_g->memmodel) == MM_TEXT) {
+        u16 tseg = GET_GLOBAL(vmode_g->sstart);
+        u16 *dest_far = text_address(cp);
+        if (pairs) {
+            // Same layout as text memory
+            memcpy_far(tseg, dest_far, seg, str, count * 2);
+            return;
+        }
+        for (; count; count--, dest_far++, str++) {
+            u16 val = (attr << 8) | GET_FARVAR(seg, *str);
+            SET_FARVAR(tseg, *dest_far, val);
+        }
+        return;
+    }
+
+    // Render runs of identical cells with a single glyph operation
+    int step = pairs ? 2 : 1;
+    while (count) {
+        struct carattr ca = {GET_FARVAR(seg, *str), attr, 1};
+        if (pairs)
+            ca.attr = GET_FARVAR(seg, str[1]);
+        int n = 1;
+        while (n < count && GET_FARVAR(seg, str[n*step]) == ca.car
+               && (!pairs || GET_FARVAR(seg, str[n*step+1]) == ca.attr))
+            n++;
+        gfx_write_char(vmode_g, cp, ca, n);
+        cp.x += n;
+        str += n * step;
+        count -= n;
+    }
+}
+
 // Return the character at the given position on the screen.
 struct carattr
 vgafb_read_char(struct cursorpos cp)
@@ -13,12 +13,14 @@ struct gfx_op {
     u8 pixels[8];
     u16 xlen, ylen;
     u16 srcy;
+    struct segoff_s font;
 };
 
 #define GO_READ8   1
 #define GO_WRITE8  2
 #define GO_MEMSET  3
 #define GO_MEMMOVE 4
+#define GO_GLYPH   5
 
 struct cursorpos {
     u8 x, y, page, pad;
@@ -31,11 +33,17 @@ struct carattr {
 // vgafb.c
 void memcpy_high(void *dest, void *src, u32 len);
 void init_gfx_op(struct gfx_op *op, struct vgamode_s *vmode_g);
+void vgafb_init_colors(void);
 void handle_gfx_op(struct gfx_op *op);
+u32 gfx_pixel_color(struct gfx_op *op);
 void *text_address(struct cursorpos cp);
+void vgafb_text_shadow_reset(struct vgamode_s *vmode_g, int cleared);
 void vgafb_scroll(struct cursorpos win, struct cursorpos winsize
                   , int lines, struct carattr ca);
 void vgafb_write_char(struct cursorpos cp, struct carattr ca);
+void vgafb_write_chars(struct cursorpos cp, struct carattr ca, int count);
+void vgafb_write_string(struct cursorpos cp, u8 attr, u16 seg, u8 *str
+                        , int count, int pairs);
 struct carattr vgafb_read_char(struct cursorpos cp);
 void vgafb_write_pixel(u8 color, u16 x, u16 y);
 u8 vgafb_read_pixel(u16 x, u16 y);
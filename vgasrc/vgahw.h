@@ -151,6 +151,16 @@ static inline int vgahw_save_restore(int cmd, u16 seg, void *data) {
     return stdvga_save_restore(cmd, seg, data);
 }
 
+// Perform a struct gfx_op with hardware assistance (returns -1 if the
+// generic framebuffer code should handle it).
+static inline int vgahw_gfx_op(struct gfx_op *op) {
+    if (CONFIG_VGA_CIRRUS)
+        return clext_gfx_op(op);
+    if (CONFIG_VGA_BOCHS)
+        return bochsvga_gfx_op(op);
+    return -1;
+}
+
 static inline int vgahw_get_linesize(struct vgamode_s *vmode_g) {
     if (CONFIG_VGA_EMULATE_TEXT)
         return cbvga_get_linesize(vmode_g);
@@ -15,6 +15,7 @@
 #include "std/pmm.h" // struct pmmheader
 #include "string.h" // checksum_far
 #include "vgabios.h" // SET_VGA
+#include "vgafb.h" // vgafb_init_colors
 #include "vgahw.h" // vgahw_setup
 #include "vgautil.h" // swcursor_check_event
 
@@ -98,6 +99,33 @@ allocate_extra_stack(void)
     return;
 }
 
+// Character shadow of the emulated text screen (see vgafb.c)
+u16 TextShadowSeg VAR16;
+u16 TextShadowCells VAR16;
+
+#define TEXT_SHADOW_MAX (32*1024)
+
+static void
+allocate_text_shadow(void)
+{
+    if (!CONFIG_VGA_EMULATE_TEXT)
+        return;
+    struct vgamode_s *vmode_g = vgahw_find_mode(0x03);
+    if (!vmode_g || GET_GLOBAL(vmode_g->memmodel) == MM_TEXT)
+        return;
+    u32 cells = ((GET_GLOBAL(vmode_g->width) / GET_GLOBAL(vmode_g->cwidth))
+                 * (GET_GLOBAL(vmode_g->height) / GET_GLOBAL(vmode_g->cheight)));
+    u32 size = ALIGN(cells * 2, 16);
+    if (size > TEXT_SHADOW_MAX)
+        return;
+    u32 res = allocate_pmm(size, 0, 0);
+    if (!res)
+        return;
+    dprintf(1, "VGA text shadow (%d cells) allocated at %x\n", cells, res);
+    SET_VGA(TextShadowSeg, res >> 4);
+    SET_VGA(TextShadowCells, cells);
+}
+
 
 /****************************************************************
  * Timer hook
@@ -187,8 +215,12 @@ vga_post(struct bregs *regs)
     extern void entry_10(void);
     SET_IVT(0x10, SEGOFF(get_global_seg(), (u32)entry_10));
 
+    vgafb_init_colors();
+
     allocate_extra_stack();
 
+    allocate_text_shadow();
+
     hook_timer_irq();
 
     SET_VGA(HaveRunInit, 1);
@@ -38,6 +38,8 @@ int clext_get_displaystart(struct vgamode_s *vmode_g);
 int clext_set_displaystart(struct vgamode_s *vmode_g, int val);
 int clext_save_restore(int cmd, u16 seg, void *data);
 int clext_set_mode(struct vgamode_s *vmode_g, int flags);
+struct gfx_op;
+int clext_gfx_op(struct gfx_op *op);
 struct bregs;
 void clext_1012(struct bregs *regs);
 int clext_setup(void);
@@ -70,6 +72,9 @@ u8 stdvga_attrindex_read(void);
 void stdvga_attrindex_write(u8 value);
 void stdvga_dac_read(u16 seg, u8 *data_far, u8 start, int count);
 void stdvga_dac_write(u16 seg, u8 *data_far, u8 start, int count);
+void stdvga_dac_read_vbe(u16 seg, u8 *data_far, u8 start, int count);
+void stdvga_dac_write_vbe(u16 seg, u8 *data_far, u8 start, int count);
+void stdvga_wait_retrace(void);
 
 // stdvgamodes.c
 struct vgamode_s *stdvga_find_mode(int mode);
@@ -102,6 +107,7 @@ extern u8 vgafont16alt[];
 // vgainit.c
 extern int VgaBDF;
 extern int HaveRunInit;
+extern u16 TextShadowSeg, TextShadowCells;
 u32 allocate_pmm(u32 size, int highmem, int aligned);
 
 // vgaversion.c